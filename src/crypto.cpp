@@ -9,14 +9,175 @@
 // IWYU pragma: no_include <oqs/common.h>
 // IWYU pragma: no_include <oqs/kem_kyber.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <openssl/aes.h>
+#include <openssl/crypto.h>
 #include <openssl/evp.h>
 #include <openssl/rand.h>
 #include <openssl/types.h>
 #include <oqs/oqs.h> // IWYU pragma: keep
+#include <pthread.h>
 #include <stdio.h>
 #include <string>
 #include <vector>
 
+// AES-256-CBC implementation, fetched once from the default provider.
+static const EVP_CIPHER* GetCipher()
+{
+    // Fetching explicitly avoids the implicit fetch done by EVP_aes_256_cbc() on every init
+    static const std::unique_ptr<EVP_CIPHER, decltype(&EVP_CIPHER_free)> cipher(EVP_CIPHER_fetch(nullptr, "AES-256-CBC", nullptr), &EVP_CIPHER_free);
+    return cipher.get();
+}
+
+// Cipher contexts of the calling thread, reused for every message. The key
+// schedule of the last message stays in them until the thread exits.
+struct CCipherContexts {
+    ///< Context used by CCrypter::EncryptData().
+    EVP_CIPHER_CTX* encrypt = EVP_CIPHER_CTX_new();
+
+    ///< Context used by CCrypter::DecryptData().
+    EVP_CIPHER_CTX* decrypt = EVP_CIPHER_CTX_new();
+
+    // Cleanses the key and IV slots once, when the thread exits
+    ~CCipherContexts()
+    {
+        EVP_CIPHER_CTX_reset(encrypt);
+        EVP_CIPHER_CTX_reset(decrypt);
+        EVP_CIPHER_CTX_free(encrypt);
+        EVP_CIPHER_CTX_free(decrypt);
+    }
+};
+
+// Retrieves the cipher contexts of the calling thread.
+static CCipherContexts& GetCipherContexts()
+{
+    thread_local CCipherContexts contexts;
+    return contexts;
+}
+
+// Binds the cipher to a context the first time, afterwards only the key and IV
+// are replaced, which keeps the provider context allocated by the first init.
+static const EVP_CIPHER* GetCipherToBind(EVP_CIPHER_CTX* ctx)
+{
+    return EVP_CIPHER_CTX_get0_cipher(ctx) ? nullptr : GetCipher();
+}
+
+// Size of the keystream buffered by the IV generator of a thread (256 IVs).
+static constexpr std::size_t IV_BUFFER_SIZE = 4096;
+
+// Number of keystream bytes produced before the IV generator is reseeded.
+static constexpr std::size_t IV_RESEED_INTERVAL = 1024 * 1024;
+
+// ChaCha20 implementation used as the keystream of the IV generators.
+static const EVP_CIPHER* GetKeystreamCipher()
+{
+    static const std::unique_ptr<EVP_CIPHER, decltype(&EVP_CIPHER_free)> cipher(EVP_CIPHER_fetch(nullptr, "ChaCha20", nullptr), &EVP_CIPHER_free);
+    return cipher.get();
+}
+
+// Number of fork() calls the process descends from, bumped in every child.
+static std::atomic<uint64_t> nForks{0};
+
+// Runs in the child after fork(), the keystreams inherited from the parent must not be reused.
+static void OnForkChild()
+{
+    nForks.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Gets the fork count, registering the fork handler on first use.
+static uint64_t GetForkCount()
+{
+    static const int nRegistered = pthread_atfork(nullptr, nullptr, OnForkChild);
+    (void)nRegistered;
+
+    return nForks.load(std::memory_order_relaxed);
+}
+
+// IV generator of a thread, a ChaCha20 keystream seeded from RAND_bytes().
+// It is kept on the heap, only a pointer to it lives in the TLS of the thread.
+struct CIVGenerator {
+    ///< Keystream context, keyed with the current seed.
+    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+
+    ///< Keystream not handed out yet, from nPos onwards.
+    unsigned char buffer[IV_BUFFER_SIZE];
+
+    ///< Position of the next unused byte in buffer.
+    std::size_t nPos = IV_BUFFER_SIZE;
+
+    ///< Keystream bytes produced since the last reseed, starts expired to force seeding.
+    std::size_t nProduced = IV_RESEED_INTERVAL;
+
+    ///< Fork count when the keystream was seeded, a child forked since then reseeds.
+    uint64_t nSeedForks = 0;
+
+    ~CIVGenerator()
+    {
+        OPENSSL_cleanse(buffer, sizeof(buffer));
+        EVP_CIPHER_CTX_free(ctx);
+    }
+
+    // Keys the keystream with a fresh 256-bit key and 128-bit counter/nonce.
+    bool Reseed()
+    {
+        unsigned char seed[32 + 16];
+        if (!ctx || !GetKeystreamCipher() || !RAND_bytes(seed, sizeof(seed))) {
+            return false;
+        }
+
+        bool ret = EVP_EncryptInit_ex2(ctx, GetKeystreamCipher(), seed, seed + 32, nullptr) == 1;
+        OPENSSL_cleanse(seed, sizeof(seed));
+
+        nProduced = 0;
+        nSeedForks = GetForkCount();
+        return ret;
+    }
+
+    // Fills the buffer with the next block of keystream.
+    bool Refill()
+    {
+        static const unsigned char zeros[IV_BUFFER_SIZE] = {};
+
+        if (nProduced >= IV_RESEED_INTERVAL && !Reseed()) {
+            return false;
+        }
+
+        int len = 0;
+        if (1 != EVP_EncryptUpdate(ctx, buffer, &len, zeros, sizeof(zeros))) {
+            return false;
+        }
+
+        nPos = 0;
+        nProduced += sizeof(buffer);
+        return true;
+    }
+
+    // Copies keystream to out, wiping the bytes handed out.
+    bool Generate(unsigned char* out, std::size_t size)
+    {
+        // After fork() the parent and the child would hand out the same IVs
+        if (nSeedForks != GetForkCount()) {
+            OPENSSL_cleanse(buffer, sizeof(buffer));
+            nPos = sizeof(buffer);
+            nProduced = IV_RESEED_INTERVAL;
+        }
+
+        if (nPos + size > sizeof(buffer) && !Refill()) {
+            // Force a reseed on the next call
+            nProduced = IV_RESEED_INTERVAL;
+            return false;
+        }
+
+        std::memcpy(out, buffer + nPos, size);
+        OPENSSL_cleanse(buffer + nPos, size);
+        nPos += size;
+        return true;
+    }
+};
+
 // Static method to generate a public/secret key pair for encryption.
 bool CCrypter::GenerateKeyPair(uint8_t* public_key, uint8_t* secret_key)
 {
@@ -92,8 +253,33 @@ bool CCrypter::RecoverSharedSecret(uint8_t* shared_secret, const uint8_t* cipher
     return true;
 }
 
+// Static method to generate a random initialization vector (IV) for AES-256-CBC.
+bool CCrypter::GenerateIV(std::vector<unsigned char>& iv)
+{
+    // Allocated on first use, so threads that never encrypt do not carry the buffer
+    thread_local std::unique_ptr<CIVGenerator> generator;
+    if (!generator) {
+        generator = std::make_unique<CIVGenerator>();
+    }
+
+    iv.resize(EVP_MAX_IV_LENGTH); // IV length is 16 bytes for AES-256-CBC
+    return generator->Generate(iv.data(), iv.size());
+}
+
 // Static method to encrypt data using AES-256-CBC.
 bool CCrypter::EncryptData(const std::vector<unsigned char>& message, std::vector<unsigned char>& enc, const uint8_t* shared_secret, std::vector<unsigned char>& iv)
+{
+    // Try to generate a random initialization vector (IV)
+    if (!GenerateIV(iv)) {
+        fprintf(stderr, "ERROR: [%s] Failed to generate IV.\n", __func__);
+        return false;
+    }
+
+    return EncryptDataWithIV(message, enc, shared_secret, iv);
+}
+
+// Static method to encrypt data using AES-256-CBC, a shared secret and a caller-supplied IV.
+bool CCrypter::EncryptDataWithIV(const std::vector<unsigned char>& message, std::vector<unsigned char>& enc, const uint8_t* shared_secret, const std::vector<unsigned char>& iv)
 {
     // Check if shared_secret is null
     if (!shared_secret) {
@@ -101,16 +287,15 @@ bool CCrypter::EncryptData(const std::vector<unsigned char>& message, std::vecto
         return false;
     }
 
-    // Check if the message is empty
-    if (message.empty()) {
-        fprintf(stderr, "ERROR: [%s] No data to encrypt. The message is empty!\n", __func__);
+    // Check the length of the IV (should be 16 bytes for AES-256-CBC)
+    if (iv.size() != EVP_MAX_IV_LENGTH) {
+        fprintf(stderr, "ERROR: [%s] Invalid IV length. Must be 16 bytes, but got %zu.\n", __func__, iv.size());
         return false;
     }
 
-    // Try to generate a random initialization vector (IV)
-    iv.resize(EVP_MAX_IV_LENGTH); // IV length is 16 bytes for AES-256-CBC
-    if (!RAND_bytes(iv.data(), iv.size())) {
-        fprintf(stderr, "ERROR: [%s] Failed to generate IV.\n", __func__);
+    // Check if the message is empty
+    if (message.empty()) {
+        fprintf(stderr, "ERROR: [%s] No data to encrypt. The message is empty!\n", __func__);
         return false;
     }
 
@@ -119,28 +304,29 @@ bool CCrypter::EncryptData(const std::vector<unsigned char>& message, std::vecto
     printf("%s: message (size=%zu): %s\n", __func__, message.size(), FormatHex(message).data());
 #endif
 
-    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
-    if (!ctx) {
+    // Reuse the encryption context of this thread
+    EVP_CIPHER_CTX* ctx = GetCipherContexts().encrypt;
+    if (!ctx || !GetCipher()) {
         fprintf(stderr, "ERROR: [%s] Failed to create cipher context.\n", __func__);
         return false;
     }
 
     // Initialize encryption operation
-    if (1 != EVP_EncryptInit_ex(ctx, EVP_aes_256_cbc(), nullptr, shared_secret, iv.data())) {
+    if (1 != EVP_EncryptInit_ex2(ctx, GetCipherToBind(ctx), shared_secret, iv.data(), nullptr)) {
         fprintf(stderr, "ERROR: [%s] Failed to initialize AES encryption.\n", __func__);
-        EVP_CIPHER_CTX_free(ctx);
+        EVP_CIPHER_CTX_reset(ctx);
         return false;
     }
 
     // Resize the encrypted vector to accommodate the message size plus padding for AES.
-    enc.resize(message.size() + EVP_CIPHER_block_size(EVP_aes_256_cbc()));
+    enc.resize(message.size() + AES_BLOCK_SIZE);
 
     int len = 0, ciphertext_len = 0;
 
     // Perform encryption
     if (1 != EVP_EncryptUpdate(ctx, enc.data(), &len, message.data(), message.size())) {
         fprintf(stderr, "ERROR: [%s] Data encryption failed.\n", __func__);
-        EVP_CIPHER_CTX_free(ctx);
+        EVP_CIPHER_CTX_reset(ctx);
         return false;
     }
     ciphertext_len = len;
@@ -148,14 +334,12 @@ bool CCrypter::EncryptData(const std::vector<unsigned char>& message, std::vecto
     // Finalize encryption
     if (1 != EVP_EncryptFinal_ex(ctx, enc.data() + len, &len)) {
         fprintf(stderr, "ERROR: [%s] Data encryption finalization failed.\n", __func__);
-        EVP_CIPHER_CTX_free(ctx);
+        EVP_CIPHER_CTX_reset(ctx);
         return false;
     }
     ciphertext_len += len;
     enc.resize(ciphertext_len); // Resize to actual encrypted size
 
-    EVP_CIPHER_CTX_free(ctx);
-
 #ifdef DEBUG
     printf("%s: enc (size=%zu): %s\n", __func__, enc.size(), FormatHex(enc).data());
 #endif
@@ -189,16 +373,17 @@ bool CCrypter::DecryptData(const std::vector<unsigned char>& enc, std::vector<un
     printf("%s: enc (size=%zu): %s\n", __func__, enc.size(), FormatHex(enc).data());
 #endif
 
-    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
-    if (!ctx) {
+    // Reuse the decryption context of this thread
+    EVP_CIPHER_CTX* ctx = GetCipherContexts().decrypt;
+    if (!ctx || !GetCipher()) {
         fprintf(stderr, "ERROR: [%s] Failed to create cipher context.\n", __func__);
         return false;
     }
 
     // Initialize decryption operation
-    if (1 != EVP_DecryptInit_ex(ctx, EVP_aes_256_cbc(), nullptr, shared_secret, iv.data())) {
+    if (1 != EVP_DecryptInit_ex2(ctx, GetCipherToBind(ctx), shared_secret, iv.data(), nullptr)) {
         fprintf(stderr, "ERROR: [%s] Failed to initialize AES decryption.\n", __func__);
-        EVP_CIPHER_CTX_free(ctx);
+        EVP_CIPHER_CTX_reset(ctx);
         return false;
     }
 
@@ -210,7 +395,7 @@ bool CCrypter::DecryptData(const std::vector<unsigned char>& enc, std::vector<un
     // Perform decryption
     if (1 != EVP_DecryptUpdate(ctx, message.data(), &len, enc.data(), enc.size())) {
         fprintf(stderr, "ERROR: [%s] Data decryption failed.\n", __func__);
-        EVP_CIPHER_CTX_free(ctx);
+        EVP_CIPHER_CTX_reset(ctx);
         return false;
     }
     plaintext_len = len;
@@ -218,17 +403,110 @@ bool CCrypter::DecryptData(const std::vector<unsigned char>& enc, std::vector<un
     // Finalize decryption
     if (1 != EVP_DecryptFinal_ex(ctx, message.data() + len, &len)) {
         fprintf(stderr, "ERROR: [%s] Data decryption finalization failed.\n", __func__);
-        EVP_CIPHER_CTX_free(ctx);
+        EVP_CIPHER_CTX_reset(ctx);
         return false;
     }
     plaintext_len += len;
     message.resize(plaintext_len); // Resize to actual decrypted size
 
-    EVP_CIPHER_CTX_free(ctx);
-
 #ifdef DEBUG
     printf("%s: message (size=%zu): %s\n", __func__, message.size(), FormatHex(message).data());
 #endif
 
     return true;
-}
\ No newline at end of file
+}
+
+// Wipes the cached key.
+CCBCMidstate::~CCBCMidstate()
+{
+    Clear();
+}
+
+// Encrypts the full blocks of a prefix and caches the chained state.
+bool CCBCMidstate::Initialize(const std::vector<unsigned char>& prefix, const uint8_t* shared_secret, const std::vector<unsigned char>& iv)
+{
+    Clear();
+
+    // Check if shared_secret is null
+    if (!shared_secret) {
+        fprintf(stderr, "ERROR: [%s] Invalid shared_secret: pointer is null.\n", __func__);
+        return false;
+    }
+
+    // Check the length of the IV (should be 16 bytes for AES-256-CBC)
+    if (iv.size() != EVP_MAX_IV_LENGTH) {
+        fprintf(stderr, "ERROR: [%s] Invalid IV length. Must be 16 bytes, but got %zu.\n", __func__, iv.size());
+        return false;
+    }
+
+    std::size_t nFullSize = prefix.size() / AES_BLOCK_SIZE * AES_BLOCK_SIZE;
+
+    // Without a full block there is nothing to cache, the tail starts at the IV
+    prefixEnc.clear();
+    chainIV = iv;
+
+    if (nFullSize > 0) {
+        // A block-aligned message gets a whole padding block, which is dropped
+        std::vector<unsigned char> fullBlocks(prefix.begin(), prefix.begin() + nFullSize);
+        if (!CCrypter::EncryptDataWithIV(fullBlocks, prefixEnc, shared_secret, iv)) {
+            fprintf(stderr, "ERROR: [%s] Failed to encrypt the prefix.\n", __func__);
+            return false;
+        }
+
+        prefixEnc.resize(nFullSize);
+        chainIV.assign(prefixEnc.end() - AES_BLOCK_SIZE, prefixEnc.end());
+    }
+
+    std::memcpy(key, shared_secret, sizeof(key));
+    this->prefix = prefix;
+    this->iv = iv;
+
+    // The prefix bytes past the full blocks start every tail
+    tail.assign(prefix.begin() + nFullSize, prefix.end());
+
+    fValid = true;
+    return true;
+}
+
+// Encrypts the prefix followed by a suffix, only encrypting the blocks after the cached ones.
+bool CCBCMidstate::Encrypt(const std::vector<unsigned char>& suffix, std::vector<unsigned char>& enc) const
+{
+    if (!fValid) {
+        fprintf(stderr, "ERROR: [%s] The midstate is not initialized.\n", __func__);
+        return false;
+    }
+
+    // Append the suffix to the prefix remainder, keeping the buffer capacity
+    std::size_t nRemainder = prefix.size() - prefixEnc.size();
+    tail.resize(nRemainder);
+    tail.insert(tail.end(), suffix.begin(), suffix.end());
+
+    if (!CCrypter::EncryptDataWithIV(tail, tailEnc, key, chainIV)) {
+        return false;
+    }
+
+    enc.resize(prefixEnc.size() + tailEnc.size());
+    std::copy(prefixEnc.begin(), prefixEnc.end(), enc.begin());
+    std::copy(tailEnc.begin(), tailEnc.end(), enc.begin() + prefixEnc.size());
+
+    return true;
+}
+
+// Drops the midstate and wipes the cached key.
+void CCBCMidstate::Clear()
+{
+    OPENSSL_cleanse(key, sizeof(key));
+    fValid = false;
+}
+
+// Gets the number of leading encrypted bytes shared by every message.
+std::size_t CCBCMidstate::GetCachedSize() const
+{
+    return fValid ? prefixEnc.size() : 0;
+}
+
+// Checks if the midstate was computed for a prefix and IV.
+bool CCBCMidstate::Matches(const std::vector<unsigned char>& prefix, const std::vector<unsigned char>& iv) const
+{
+    return fValid && this->iv == iv && this->prefix == prefix;
+}
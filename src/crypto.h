@@ -5,6 +5,7 @@
 #ifndef QYRA_CRYPTO_H
 #define QYRA_CRYPTO_H
 
+#include <cstddef>
 #include <cstdint>
 #include <vector>
 
@@ -46,9 +47,24 @@ public:
      */
     static bool RecoverSharedSecret(uint8_t* shared_secret, const uint8_t* ciphertext, const uint8_t* secret_key);
 
+    /**
+     * @brief Generates a random initialization vector (IV) for AES-256-CBC.
+     *
+     * The IV is taken from a ChaCha20 keystream private to the calling thread,
+     * which is seeded from RAND_bytes() and reseeded periodically, so mining
+     * threads do not contend on the global OpenSSL DRBG for every nonce.
+     *
+     * @param iv A reference to a vector where the generated IV will be stored.
+     *
+     * @return true if the IV was generated successfully, false otherwise.
+     */
+    static bool GenerateIV(std::vector<unsigned char>& iv);
+
     /**
      * @brief Encrypts data using AES-256-CBC and a shared secret.
      *
+     * A fresh IV is generated with GenerateIV().
+     *
      * @param message The data to be encrypted.
      * @param enc A reference to a vector where the encrypted data will be stored.
      * @param shared_secret A pointer to the shared secret used as the encryption key.
@@ -58,6 +74,21 @@ public:
      */
     static bool EncryptData(const std::vector<unsigned char>& message, std::vector<unsigned char>& enc, const uint8_t* shared_secret, std::vector<unsigned char>& iv);
 
+    /**
+     * @brief Encrypts data using AES-256-CBC, a shared secret and a caller-supplied IV.
+     *
+     * Intended for deterministic testing and benchmarking; an IV must never be
+     * reused with the same shared secret.
+     *
+     * @param message The data to be encrypted.
+     * @param enc A reference to a vector where the encrypted data will be stored.
+     * @param shared_secret A pointer to the shared secret used as the encryption key.
+     * @param iv The initialization vector (IV), 16 bytes.
+     *
+     * @return true if the encryption was successful, false otherwise.
+     */
+    static bool EncryptDataWithIV(const std::vector<unsigned char>& message, std::vector<unsigned char>& enc, const uint8_t* shared_secret, const std::vector<unsigned char>& iv);
+
     /**
      * @brief Decrypts data using AES-256-CBC and a shared secret.
      *
@@ -71,4 +102,91 @@ public:
     static bool DecryptData(const std::vector<unsigned char>& enc, std::vector<unsigned char>& message, const uint8_t* shared_secret, const std::vector<unsigned char>& iv);
 };
 
+/**
+ * @brief AES-256-CBC state after the full blocks of a fixed message prefix.
+ *
+ * With the same key and IV, CBC encrypts a common prefix to the same blocks,
+ * so a header followed by a varying nonce only needs its last blocks encrypted
+ * again. The midstate keeps the ciphertext of the full prefix blocks, the bytes
+ * of the prefix past them, and the last ciphertext block, which chains into the
+ * encryption of the tail. Encrypt() returns exactly what EncryptDataWithIV()
+ * returns for the whole message.
+ */
+class CCBCMidstate
+{
+public:
+    /**
+     * @brief Wipes the cached key.
+     */
+    ~CCBCMidstate();
+
+    /**
+     * @brief Encrypts the full blocks of a prefix and caches the chained state.
+     *
+     * @param prefix The fixed start of every message.
+     * @param shared_secret A pointer to the shared secret used as the encryption key.
+     * @param iv The initialization vector (IV), 16 bytes.
+     *
+     * @return true if the midstate was computed, false otherwise.
+     */
+    bool Initialize(const std::vector<unsigned char>& prefix, const uint8_t* shared_secret, const std::vector<unsigned char>& iv);
+
+    /**
+     * @brief Encrypts the prefix followed by a suffix, only encrypting the blocks after the cached ones.
+     *
+     * @param suffix The data following the prefix, not empty.
+     * @param enc A reference to a vector where the encrypted message will be stored.
+     *
+     * @return true if the encryption was successful, false otherwise.
+     */
+    bool Encrypt(const std::vector<unsigned char>& suffix, std::vector<unsigned char>& enc) const;
+
+    /**
+     * @brief Drops the midstate and wipes the cached key.
+     */
+    void Clear();
+
+    /**
+     * @brief Gets the number of leading encrypted bytes shared by every message.
+     *
+     * @return The size of the ciphertext of the full prefix blocks.
+     */
+    std::size_t GetCachedSize() const;
+
+    /**
+     * @brief Checks if the midstate was computed for a prefix and IV.
+     *
+     * @param prefix The fixed start of every message.
+     * @param iv The initialization vector (IV).
+     *
+     * @return true if Encrypt() may be used for messages starting with prefix under iv.
+     */
+    bool Matches(const std::vector<unsigned char>& prefix, const std::vector<unsigned char>& iv) const;
+
+private:
+    ///< True once Initialize() succeeded.
+    bool fValid = false;
+
+    ///< AES-256 key the midstate was computed with.
+    uint8_t key[32];
+
+    ///< Prefix the midstate was computed for.
+    std::vector<unsigned char> prefix;
+
+    ///< IV the midstate was computed with.
+    std::vector<unsigned char> iv;
+
+    ///< Ciphertext of the full blocks of the prefix.
+    std::vector<unsigned char> prefixEnc;
+
+    ///< IV of the tail encryption, the last ciphertext block of the prefix (or the IV).
+    std::vector<unsigned char> chainIV;
+
+    ///< Scratch buffer holding the tail of the message.
+    mutable std::vector<unsigned char> tail;
+
+    ///< Scratch buffer holding the encrypted tail.
+    mutable std::vector<unsigned char> tailEnc;
+};
+
 #endif // QYRA_CRYPTO_H
\ No newline at end of file
@@ -6,25 +6,33 @@
 
 #include <crypto.h>
 #include <hash.h>
+#include <kempool.h>
 #include <qyra.h>
 #include <stream.h>
 #include <utils.h>
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cassert>
 #include <fstream>
+#include <numeric>
 #include <stdio.h>
 #include <thread>
-#include <unordered_set>
 #include <utility>
 
-// Constructor of the CGraph class.
-// Initializes the adjacency matrix with a maximum number of nodes.
-CGraph::CGraph() : adjacencyMatrix(MAX_NODES) {}
+// Constructor of the CBasicGraph class.
+// Initializes an empty successor array.
+template <unsigned int Bits>
+CBasicGraph<Bits>::CBasicGraph()
+{
+    successors.fill(0);
+    inDegree.fill(0);
+}
 
 // Adds an edge between two nodes in the graph.
-bool CGraph::AddEdge(uint16_t from, uint16_t to)
+template <unsigned int Bits>
+bool CBasicGraph<Bits>::AddEdge(uint16_t from, uint16_t to)
 {
     // Check if the 'from' and 'to' nodes are valid (less than MAX_NODES)
     if (from >= MAX_NODES) {
@@ -40,31 +48,79 @@ bool CGraph::AddEdge(uint16_t from, uint16_t to)
         return false;
     }
 
+    // An edge that does not come from the data cannot be rolled back safely
+    DropCheckpoint();
+
+    InsertEdge(from, to);
+
+    // Return true on success
+    return true;
+}
+
+// Records an edge between two nodes known to be in range.
+template <unsigned int Bits>
+void CBasicGraph<Bits>::InsertEdge(uint16_t from, uint16_t to)
+{
     // Skip processing if the 'from' node has already been modified.
-    if (!adjacencyMatrix[from].none()) {
-        return true;
+    if (occupancy.test(from)) {
+        return;
     }
 
 #ifdef DEBUG
     printf("%s: %u -> %u\n", __func__, from, to);
 #endif
 
-    // Reset the bitset for the 'from' node, clearing all edges from this node.
-    adjacencyMatrix[from].reset();
+    // Record the edge from 'from' to 'to'.
+    successors[from] = to;
+    occupancy.set(from);
 
-    // Set the bit indicating an edge from 'from' to 'to'.
-    adjacencyMatrix[from].set(to);
+    // Remember the edge, so the next build can roll back to the checkpoint.
+    if (fCheckpoint) {
+        undoLog.push_back(from);
+    }
 
-    // Return true on success
-    return true;
+    // Update the root index: 'from' is a root until something points to it,
+    // and 'to' stops being one as soon as it gets an incoming edge.
+    if (inDegree[from] == 0) {
+        roots.set(from);
+    }
+    if (inDegree[to]++ == 0) {
+        roots.reset(to);
+    }
 }
 
-// Initializes the graph and generates cryptographic keys.
-bool CGraph::Initialize(const uint8_t* public_key, const uint8_t* secret_key)
+// Removes the edges added since the checkpoint.
+template <unsigned int Bits>
+void CBasicGraph<Bits>::RollbackToCheckpoint()
+{
+    // Undo the edges in reverse order; a node is a root when it has an outgoing
+    // edge and no incoming one, so the roots follow from occupancy and in-degree.
+    for (auto it = undoLog.rbegin(); it != undoLog.rend(); ++it) {
+        uint16_t from = *it;
+        uint16_t to = successors[from];
+
+        occupancy.reset(from);
+        roots.reset(from);
+
+        if (--inDegree[to] == 0 && occupancy.test(to)) {
+            roots.set(to);
+        }
+    }
+    undoLog.clear();
+}
+
+// Forgets the checkpoint, the graph is kept as is.
+template <unsigned int Bits>
+void CBasicGraph<Bits>::DropCheckpoint()
 {
-    // Initialize the adjacency matrix with bitsets
-    adjacencyMatrix.resize(MAX_NODES);
+    fCheckpoint = false;
+    undoLog.clear();
+}
 
+// Initializes the graph and generates cryptographic keys.
+template <unsigned int Bits>
+bool CBasicGraph<Bits>::Initialize(const uint8_t* public_key, const uint8_t* secret_key)
+{
     // Check if public_key is null
     if (!public_key) {
         fprintf(stderr, "ERROR: [%s] Invalid public_key: pointer is null.\n", __func__);
@@ -87,36 +143,123 @@ bool CGraph::Initialize(const uint8_t* public_key, const uint8_t* secret_key)
     // Copy the content of secret_key to secretKey
     std::copy(secret_key, secret_key + OQS_KEM_kyber_768_length_secret_key, secretKey);
 
+    // An encapsulation made with the previous public key cannot be reused
+    ResetEncapsulation();
+
     // Return true on success
     return true;
 }
 
-void CGraph::Clear()
+// Initializes the graph with the keys of another graph.
+template <unsigned int Bits>
+bool CBasicGraph<Bits>::Initialize(const CBasicGraph<Bits>& other)
 {
-    // Clear adjacencyMatrix
-    adjacencyMatrix.clear();
+    return Initialize(other.publicKey, other.secretKey);
+}
 
-    // Initialize the adjacency matrix with bitsets
-    adjacencyMatrix.resize(MAX_NODES);
+// Wipes the keys and drops the header, nonce, encrypted data, IV and ciphertext.
+template <unsigned int Bits>
+void CBasicGraph<Bits>::Wipe()
+{
+    OQS_MEM_cleanse(publicKey, sizeof(publicKey));
+    OQS_MEM_cleanse(secretKey, sizeof(secretKey));
+    OQS_MEM_cleanse(ciphertext, sizeof(ciphertext));
+
+    // Also wipes the shared secret and the header midstate
+    ResetEncapsulation();
+
+    header.clear();
+    nonce.clear();
+    enc.clear();
+    iv.clear();
+}
+
+template <unsigned int Bits>
+void CBasicGraph<Bits>::Clear()
+{
+    // Only the targets of the current edges have an in-degree to reset
+    for (std::size_t from = occupancy._Find_first(); from < MAX_NODES; from = occupancy._Find_next(from)) {
+        inDegree[successors[from]] = 0;
+    }
+
+    // Drop all edges; successors are only meaningful where occupancy is set
+    occupancy.reset();
+    roots.reset();
+
+    // There is nothing left to roll back to
+    DropCheckpoint();
 }
 
 // Sets the header used in cryptographic operations.
-void CGraph::SetHeader(const std::vector<unsigned char>& vch)
+template <unsigned int Bits>
+void CBasicGraph<Bits>::SetHeader(const std::vector<unsigned char>& vch)
 {
+    // An encapsulation is only shared by the nonces of one header
+    if (vch != header) {
+        ResetEncapsulation();
+    }
+
     header = vch;
 }
 
 // Sets the nonce used in cryptographic operations.
-void CGraph::SetNonce(const std::vector<unsigned char>& vch)
+template <unsigned int Bits>
+void CBasicGraph<Bits>::SetNonce(const std::vector<unsigned char>& vch)
 {
     nonce = vch;
 }
 
+// Sets how many nonces share one key encapsulation in Generate().
+template <unsigned int Bits>
+void CBasicGraph<Bits>::SetEncapsulationReuse(unsigned int numNonces, bool fShareIV)
+{
+    nEncapsulationReuse = numNonces;
+    fEncapsulationShareIV = fShareIV;
+    ResetEncapsulation();
+}
+
+// Drops the current encapsulation and wipes its shared secret.
+template <unsigned int Bits>
+void CBasicGraph<Bits>::ResetEncapsulation()
+{
+    OQS_MEM_cleanse(sharedSecret, sizeof(sharedSecret));
+    nEncapsulationUses = 0;
+
+    // The midstate was computed with the dropped shared secret
+    headerMidstate.Clear();
+}
+
+// Sets a fixed initialization vector for Generate().
+template <unsigned int Bits>
+void CBasicGraph<Bits>::SetIV(const std::vector<unsigned char>& vch)
+{
+    fixedIV = vch;
+
+    // Neither the midstate nor a shared IV may outlive the previous setting
+    headerMidstate.Clear();
+    iv.clear();
+}
+
 // Private function to update the graph with the given data.
-bool CGraph::UpdateGraphFromData(const std::vector<unsigned char>& data)
+template <unsigned int Bits>
+bool CBasicGraph<Bits>::UpdateGraphFromData(const std::vector<unsigned char>& data, std::size_t nSharedPrefix)
 {
-    // Avoid dirty adjacencyMatrix
-    Clear();
+    // Smallest number of bytes holding a whole number of node indices
+    constexpr std::size_t GROUP_BYTES = std::lcm(Bits, 8u) / 8;
+
+    // Only whole groups can be decoded apart from the rest of the data
+    std::size_t nShared = std::min(nSharedPrefix, data.size()) / GROUP_BYTES * GROUP_BYTES;
+
+    // Resume from the checkpoint if it was built from the same leading bytes
+    bool fResume = fCheckpoint && nShared > 0 && checkpointPrefix.size() == nShared &&
+                   std::equal(checkpointPrefix.begin(), checkpointPrefix.end(), data.begin());
+
+    if (fResume) {
+        RollbackToCheckpoint();
+    } else {
+        // Avoid dirty adjacencyMatrix
+        Clear();
+    }
 
     // Check if data is empty
     if (data.empty()) {
@@ -126,83 +269,173 @@ bool CGraph::UpdateGraphFromData(const std::vector<unsigned char>& data)
         return false;
     }
 
-    // Initialize a set to keep track of visited nodes.
-    std::unordered_set<uint16_t> visited;
-
-    // Convert data to std::vector<uint16_t>
-    std::vector<uint16_t> edges = Pack12(data);
-
-    // Check if the edges vector is valid
-    if (edges.size() < 2) {
+    // Node indices held by the data, the last group of bytes being zero padded
+    if (GetPackBitsCount<Bits>(data.size()) < 2) {
         fprintf(stderr, "ERROR: [%s] Insufficient edges to update the graph!\n", __func__);
 
         // Return false on failure
         return false;
     }
 
-    // Update the adjacency matrix with edges based on the converted data.
-    for (std::size_t i = 0; i < (edges.size() - 1); ++i) {
-        // Starting node of the edge.
-        uint16_t from = edges[i];
+    // Nodes already used as the start of an edge. Every such node becomes an
+    // occupied row, so the occupancy bitmap tracks them without any allocation.
+    const std::bitset<MAX_NODES>& visited = occupancy;
 
-        // Ending node of the edge.
-        uint16_t to = edges[i + 1];
+    // Starting node of the next edge, none before the first index is decoded.
+    bool fHaveFrom = fResume ? fCheckpointHaveFrom : false;
+    uint16_t from = fResume ? checkpointFrom : 0;
 
+    // Adds the edge ending at the next decoded node index, if it is allowed.
+    auto addNode = [&](uint16_t to) {
         // Avoid adding a self-loop and prevent creating cycles.
-        if (from != to && visited.find(to) == visited.end()) {
+        if (fHaveFrom && from != to && !visited.test(to)) {
             // Add an edge to the adjacency matrix.
-            if (!AddEdge(from, to)) {
-                fprintf(stderr, "ERROR: [%s] Failed to add edge from %u to %u!\n", __func__, from, to);
+            InsertEdge(from, to);
+        }
 
-                // Return false on failure
-                return false;
-            }
+        // The ending node starts the next edge.
+        fHaveFrom = true;
+        from = to;
 
-            // Attempt to add the 'from' node to the visited set.
-            auto result = visited.insert(from);
-            if (!result.second) {
-#ifdef DEBUG
-                fprintf(stderr, "ERROR: [%s] Node %u was already visited!\n", __func__, from);
-#endif
+        return true;
+    };
+
+    // Decodes a range of the data starting on a group boundary, adding its edges.
+    auto decode = [&](const unsigned char* begin, std::size_t size) {
+        if constexpr (Bits == 12) {
+            // Node indices decoded at once into a stack buffer
+            constexpr std::size_t BLOCK_GROUPS = 64;
+            std::array<uint16_t, BLOCK_GROUPS * 2> block;
+
+            // Decode the whole groups of 3 bytes in blocks with the fastest kernel,
+            // then the zero padded tail, adding the edges between consecutive indices.
+            Pack12Kernel kernel = GetPack12Kernel();
+            std::size_t numGroups = size / 3;
+
+            for (std::size_t i = 0; i < numGroups; i += BLOCK_GROUPS) {
+                std::size_t blockGroups = std::min(BLOCK_GROUPS, numGroups - i);
+                Unpack12Groups(begin + i * 3, blockGroups, block.data(), kernel);
+
+                for (std::size_t j = 0; j < blockGroups * 2; ++j) {
+                    if (!addNode(block[j])) {
+                        return false;
+                    }
+                }
             }
+
+            return ForEachPack12(begin + numGroups * 3, size - numGroups * 3, addNode);
+        } else {
+            // Other widths go through the generic unpacker
+            return ForEachPackBits<Bits>(begin, size, addNode);
+        }
+    };
+
+    bool fSuccess = true;
+    std::size_t offset = 0;
+
+    if (fResume) {
+        // The edges of the shared bytes are already in place
+        offset = nShared;
+    } else if (nShared > 0) {
+        // Build the graph of the shared bytes and checkpoint it
+        fSuccess = decode(data.data(), nShared);
+        if (fSuccess) {
+            static std::atomic<uint64_t> nNextCheckpointId{1};
+
+            fCheckpoint = true;
+            checkpointPrefix.assign(data.begin(), data.begin() + nShared);
+            fCheckpointHaveFrom = fHaveFrom;
+            checkpointFrom = from;
+            checkpointOccupancy = occupancy;
+            checkpointRoots = roots;
+            nCheckpointId = nNextCheckpointId.fetch_add(1);
+            undoLog.clear();
+
+            offset = nShared;
         }
     }
 
+    if (fSuccess) {
+        fSuccess = decode(data.data() + offset, data.size() - offset);
+    }
+
+    if (!fSuccess) {
+        fprintf(stderr, "ERROR: [%s] Failed to add edge from node %u!\n", __func__, from);
+
+        // Return false on failure
+        return false;
+    }
+
     // Return true on success
     return true;
 }
 
 // Encrypts the graph's data and updates the adjacency matrix with the encrypted data.
-bool CGraph::Generate()
+template <unsigned int Bits>
+bool CBasicGraph<Bits>::Generate()
 {
-    // Combine the header and nonce into a single vector for encryption.
-    CStream s;
-    s << header;
-    s << nonce;
-
-#ifdef DEBUG
-    printf("%s: s.Data() (size=%zu): %s\n", __func__, s.Size(), s.GetHex().data());
-#endif
-
     // Create an instance of CCrypter
     CCrypter crypter;
 
-    // Generate a shared secret and ciphertext.
-    uint8_t sharedSecret[OQS_KEM_kyber_768_length_shared_secret];
-    if (!crypter.GenerateCiphertext(ciphertext, sharedSecret, publicKey)) {
-        fprintf(stderr, "ERROR: [%s] Failed to generate ciphertext!\n", __func__);
+    // Generate a shared secret and ciphertext, unless the current ones may be reused.
+    // A precomputed encapsulation is taken from the background pool when one is ready.
+    if (nEncapsulationUses == 0 || (nEncapsulationReuse != 0 && nEncapsulationUses >= nEncapsulationReuse)) {
+        ResetEncapsulation();
 
-        // Return false on failure
-        return false;
+        if (!CKEMPool::Get().Take(ciphertext, sharedSecret, publicKey) &&
+            !crypter.GenerateCiphertext(ciphertext, sharedSecret, publicKey)) {
+            fprintf(stderr, "ERROR: [%s] Failed to generate ciphertext!\n", __func__);
+
+            // Return false on failure
+            return false;
+        }
     }
+    ++nEncapsulationUses;
 
 #ifdef DEBUG
     printf("%s: sharedSecret (size=%zu): %s\n", __func__, sizeof(sharedSecret), FormatHex(sharedSecret).data());
     printf("%s: ciphertext   (size=%zu): %s\n", __func__, sizeof(ciphertext), FormatHex(ciphertext).data());
 #endif
 
-    // Encrypt the data.
-    if (!crypter.EncryptData(s.Data(), enc, sharedSecret, iv)) {
+    // Pick the IV: the supplied one, the one shared by the nonces of this
+    // encapsulation, or a fresh one.
+    if (!fixedIV.empty()) {
+        iv = fixedIV;
+    } else if (!fEncapsulationShareIV || nEncapsulationUses == 1 || iv.empty()) {
+        if (!crypter.GenerateIV(iv)) {
+            fprintf(stderr, "ERROR: [%s] Failed to generate IV!\n", __func__);
+
+            // Return false on failure
+            return false;
+        }
+    }
+
+    // Encrypt the data. When the key and IV outlive this nonce, the header blocks
+    // are encrypted once into a midstate and only the nonce blocks are encrypted here.
+    bool fEncrypted;
+    bool fMidstate = nEncapsulationReuse != 1 && (!fixedIV.empty() || fEncapsulationShareIV);
+    if (fMidstate) {
+        if (!headerMidstate.Matches(header, iv) && !headerMidstate.Initialize(header, sharedSecret, iv)) {
+            fprintf(stderr, "ERROR: [%s] Failed to compute the header midstate!\n", __func__);
+
+            // Return false on failure
+            return false;
+        }
+        fEncrypted = headerMidstate.Encrypt(nonce, enc);
+    } else {
+        // Combine the header and nonce into a single vector for encryption.
+        CStream s;
+        s << header;
+        s << nonce;
+
+#ifdef DEBUG
+        printf("%s: s.Data() (size=%zu): %s\n", __func__, s.Size(), s.GetHex().data());
+#endif
+
+        fEncrypted = crypter.EncryptDataWithIV(s.Data(), enc, sharedSecret, iv);
+    }
+
+    if (!fEncrypted) {
         fprintf(stderr, "ERROR: [%s] Encryption failed!\n", __func__);
 
         // Return false on failure
@@ -214,8 +447,9 @@ bool CGraph::Generate()
     printf("%s: enc (size=%zu): %s\n", __func__, enc.size(), FormatHex(enc).data());
 #endif
 
-    // Update the graph using the encrypted data.
-    if (!UpdateGraphFromData(enc)) {
+    // Update the graph using the encrypted data. The header blocks of the midstate
+    // are the same for every nonce, so only the edges of the nonce blocks are rebuilt.
+    if (!UpdateGraphFromData(enc, fMidstate ? headerMidstate.GetCachedSize() : 0)) {
         fprintf(stderr, "ERROR: [%s] Failed to update graph from encrypted data!\n", __func__);
 
         // Return false on failure
@@ -226,9 +460,9 @@ bool CGraph::Generate()
     return true;
 }
 
-// Validates if the provided data was generated from a correct graph
-// created with the right header and nonce.
-bool CGraph::Validate(const std::vector<unsigned char>& vch)
+// Checks that a solution holds enc, iv and ciphertext and nothing else.
+template <unsigned int Bits>
+bool CBasicGraph<Bits>::CheckSolutionSize(const std::vector<unsigned char>& vch)
 {
     // Check if the input vector is empty
     if (vch.empty()) {
@@ -241,12 +475,53 @@ bool CGraph::Validate(const std::vector<unsigned char>& vch)
     // Ensure the size of vch matches the expected size for enc, iv, and ciphertext.
     if (vch.size() != TOTAL_SIZE) {
         // Invalid data size for enc, iv, and ciphertext.
-        fprintf(stderr, "ERROR: [%s] Invalid data size for enc, iv, and ciphertext: expected %u, got %zu.\n", __func__, TOTAL_SIZE, vch.size());
+        fprintf(stderr, "ERROR: [%s] Invalid data size for enc, iv, and ciphertext: expected %zu, got %zu.\n", __func__, TOTAL_SIZE, vch.size());
+
+        // Return false on failure
+        return false;
+    }
+
+    // Return true on success
+    return true;
+}
+
+// Validates if the provided data was generated from a correct graph
+// created with the right header and nonce.
+template <unsigned int Bits>
+bool CBasicGraph<Bits>::Validate(const std::vector<unsigned char>& vch)
+{
+    if (!CheckSolutionSize(vch)) {
+        // Return false on failure
+        return false;
+    }
+
+    UnpackSolution(vch);
+
+    // Check the encryption first, the graph is only built for a genuine solution
+    if (!CheckEncryption(enc, iv, ciphertext, nullptr)) {
+        // Return false on failure
+        return false;
+    }
+
+    // Update the graph using the encrypted data.
+    if (!UpdateGraphFromData(enc)) {
+        fprintf(stderr, "ERROR: [%s] Failed to update the graph from encrypted data.\n", __func__);
 
         // Return false on failure
         return false;
     }
 
+    // Return true on success
+    return true;
+}
+
+// Unpacks a solution of the right size into enc, iv and ciphertext.
+template <unsigned int Bits>
+void CBasicGraph<Bits>::UnpackSolution(const std::vector<unsigned char>& vch)
+{
+    // The ciphertext of the solution replaces the one of the current encapsulation
+    ResetEncapsulation();
+
     enc.resize(ENC_SIZE);
     iv.resize(IV_SIZE);
 
@@ -255,20 +530,50 @@ bool CGraph::Validate(const std::vector<unsigned char>& vch)
     s >> enc;
     s >> iv;
     s >> ciphertext;
+}
+
+// Checks that the encrypted data of a solution decrypts to the header and nonce.
+template <unsigned int Bits>
+bool CBasicGraph<Bits>::CheckEncryption(const std::vector<unsigned char>& vch, const std::atomic<bool>* pfCancel) const
+{
+    if (!CheckSolutionSize(vch)) {
+        // Return false on failure
+        return false;
+    }
+
+    // Unpack the solution into local copies, the members belong to LoadSolution()
+    std::vector<unsigned char> solutionEnc(ENC_SIZE);
+    std::vector<unsigned char> solutionIV(IV_SIZE);
+    uint8_t solutionCiphertext[OQS_KEM_kyber_768_length_ciphertext];
+
+    CStream s(vch);
+    s >> solutionEnc;
+    s >> solutionIV;
+    s >> solutionCiphertext;
 
 #ifdef DEBUG
     printf("%s: ss (size=%zu): %s\n", __func__, s.Size(), s.GetHex().data());
-    printf("%s: enc (size=%zu): %s\n", __func__, enc.size(), FormatHex(enc).data());
-    printf("%s: iv (size=%zu): %s\n", __func__, iv.size(), FormatHex(iv).data());
-    printf("%s: ciphertext (size=%zu): %s\n", __func__, sizeof(ciphertext), FormatHex(ciphertext).data());
+#endif
+
+    return CheckEncryption(solutionEnc, solutionIV, solutionCiphertext, pfCancel);
+}
+
+// Checks that unpacked encrypted data decrypts to the header and nonce.
+template <unsigned int Bits>
+bool CBasicGraph<Bits>::CheckEncryption(const std::vector<unsigned char>& solutionEnc, const std::vector<unsigned char>& solutionIV, const uint8_t (&solutionCiphertext)[OQS_KEM_kyber_768_length_ciphertext], const std::atomic<bool>* pfCancel) const
+{
+#ifdef DEBUG
+    printf("%s: enc (size=%zu): %s\n", __func__, solutionEnc.size(), FormatHex(solutionEnc).data());
+    printf("%s: iv (size=%zu): %s\n", __func__, solutionIV.size(), FormatHex(solutionIV).data());
+    printf("%s: ciphertext (size=%zu): %s\n", __func__, sizeof(solutionCiphertext), FormatHex(solutionCiphertext).data());
 #endif
 
     // Create an instance of CCrypter
     CCrypter crypter;
 
     // Recover the shared secret using the ciphertext and the secret key.
-    uint8_t sharedSecret[OQS_KEM_kyber_768_length_shared_secret];
-    if (!crypter.RecoverSharedSecret(sharedSecret, ciphertext, secretKey)) {
+    uint8_t solutionSecret[OQS_KEM_kyber_768_length_shared_secret];
+    if (!crypter.RecoverSharedSecret(solutionSecret, solutionCiphertext, secretKey)) {
         fprintf(stderr, "ERROR: [%s] Failed to recover shared secret.\n", __func__);
 
         // Return false on failure
@@ -276,16 +581,21 @@ bool CGraph::Validate(const std::vector<unsigned char>& vch)
     }
 
 #ifdef DEBUG
-    printf("%s: sharedSecret (size=%zu): %s\n", __func__, sizeof(sharedSecret), FormatHex(sharedSecret).data());
+    printf("%s: sharedSecret (size=%zu): %s\n", __func__, sizeof(solutionSecret), FormatHex(solutionSecret).data());
 #endif
 
-#ifdef DEBUG
-    printf("%s: enc (size=%zu): %s\n", __func__, enc.size(), FormatHex(enc).data());
-#endif
+    // The other half of the validation already failed, skip the decryption
+    if (pfCancel && pfCancel->load(std::memory_order_relaxed)) {
+        OQS_MEM_cleanse(solutionSecret, sizeof(solutionSecret));
+        return false;
+    }
 
     // Decrypt the encrypted data (enc) using the recovered shared secret and the IV.
     std::vector<unsigned char> decryptedMessage;
-    if (!crypter.DecryptData(enc, decryptedMessage, sharedSecret, iv)) {
+    bool fDecrypted = crypter.DecryptData(solutionEnc, decryptedMessage, solutionSecret, solutionIV);
+    OQS_MEM_cleanse(solutionSecret, sizeof(solutionSecret));
+
+    if (!fDecrypted) {
         fprintf(stderr, "ERROR: [%s] Failed to decrypt data.\n", __func__);
 
         // Return false on failure
@@ -301,11 +611,21 @@ bool CGraph::Validate(const std::vector<unsigned char>& vch)
     printf("%s: expectedMessage (size=%zu): %s\n", __func__, expectedMessage.size(), FormatHex(expectedMessage).data());
 #endif
 
-    if (decryptedMessage != expectedMessage) {
-        // The decrypted message doesn't match the expected header + nonce.
+    // The decrypted message must match the expected header + nonce.
+    return decryptedMessage == expectedMessage;
+}
+
+// Builds the graph from the encrypted data of a solution.
+template <unsigned int Bits>
+bool CBasicGraph<Bits>::LoadSolution(const std::vector<unsigned char>& vch)
+{
+    if (!CheckSolutionSize(vch)) {
+        // Return false on failure
         return false;
     }
 
+    UnpackSolution(vch);
+
     // Update the graph using the encrypted data.
     if (!UpdateGraphFromData(enc)) {
         fprintf(stderr, "ERROR: [%s] Failed to update the graph from encrypted data.\n", __func__);
@@ -318,107 +638,187 @@ bool CGraph::Validate(const std::vector<unsigned char>& vch)
     return true;
 }
 
-// Computes the hash of the graph's adjacency matrix.
-std::vector<unsigned char> CGraph::GetHash() const
-{
-    // Create a vector to hold the rows' binary data
-    std::vector<unsigned char> data;
-
-    // Process each row of the adjacency matrix
-    for (const auto& row : adjacencyMatrix) {
-        // Create a temporary vector for the current row
-        std::vector<unsigned char> rowBytes(MAX_NODES / 8, 0);
-
-        if (!row.none()) {
-            // Fill the rowBytes vector from the bitset
-            for (std::size_t i = 0; i < MAX_NODES; ++i) {
-                if (row[i]) {
-                    // Set the appropriate bit
-                    rowBytes[i / 8] |= (1 << (i % 8));
-                }
-            }
+// Streams the serialized adjacency matrix row by row.
+template <unsigned int Bits>
+void CBasicGraph<Bits>::WriteAdjacencyMatrix(const std::function<void(const unsigned char*, std::size_t)>& sink) const
+{
+    // Size of a serialized row in bytes
+    constexpr std::size_t ROW_SIZE = MAX_NODES / 8;
+
+    // Shared source of the empty rows
+    static const std::array<unsigned char, ROW_SIZE> zeroRow{};
+
+    // Buffer of a populated row, all zero between rows
+    std::array<unsigned char, ROW_SIZE> rowBytes{};
+
+    std::size_t row = 0;
+    for (std::size_t from = occupancy._Find_first(); from < MAX_NODES; from = occupancy._Find_next(from)) {
+        // Feed the empty rows before this one
+        for (; row < from; ++row) {
+            sink(zeroRow.data(), ROW_SIZE);
         }
 
-        // Append the current row's bytes to data
-        data.insert(data.end(), rowBytes.begin(), rowBytes.end());
+        // Set the bit of the only edge leaving this row, then clear it again
+        uint16_t to = successors[from];
+        rowBytes[to / 8] = (1 << (to % 8));
+        sink(rowBytes.data(), ROW_SIZE);
+        rowBytes[to / 8] = 0;
+
+        ++row;
     }
 
-    // Return the hash of the byte vector.
-    return CHasher::BLAKE3(data);
+    // Feed the empty rows after the last populated one
+    for (; row < MAX_NODES; ++row) {
+        sink(zeroRow.data(), ROW_SIZE);
+    }
 }
 
-// Converts the graph's adjacency matrix to a string representation.
-std::string CGraph::ToString() const
-{
-    // Create a vector to hold the rows' binary data
-    std::vector<unsigned char> data;
-
-    // Process each row of the adjacency matrix
-    for (const auto& row : adjacencyMatrix) {
-        // Create a temporary vector for the current row
-        std::array<unsigned char, MAX_NODES / 8> rowBytes = {0};
-        if (!row.none()) {
-            for (std::size_t i = 0; i < MAX_NODES; ++i) {
-                if (row[i]) {
-                    // Set the appropriate bit
-                    rowBytes[i / 8] |= (1 << (i % 8));
-                }
-            }
+// Computes the hash of the graph's adjacency matrix.
+template <unsigned int Bits>
+std::vector<unsigned char> CBasicGraph<Bits>::GetHash(unsigned int version) const
+{
+    if (version == GRAPH_DIGEST_V2) {
+        // Version and width of a node index, then the edges in increasing 'from' order
+        CStream s;
+        s << static_cast<uint16_t>(GRAPH_DIGEST_V2);
+        s << static_cast<uint16_t>(NODE_BITS);
+
+        for (std::size_t from = occupancy._Find_first(); from < MAX_NODES; from = occupancy._Find_next(from)) {
+            s << static_cast<uint16_t>(from);
+            s << successors[from];
         }
 
-        // Append the current row's bytes to data
-        data.insert(data.end(), rowBytes.begin(), rowBytes.end());
+        // Return the hash of the edge list.
+        return CHasher::BLAKE3(s.Data());
     }
 
+    if (version != GRAPH_DIGEST_V1) {
+        fprintf(stderr, "ERROR: [%s] Unknown graph digest version: %u\n", __func__, version);
+
+        // Return an empty hash on failure
+        return {};
+    }
+
+    // Stream the rows straight into the hasher
+    CHashWriter writer;
+    WriteAdjacencyMatrix([&writer](const unsigned char* data, std::size_t size) {
+        writer.Write(data, size);
+    });
+
+    // Return the hash of the rows.
+    return writer.Finalize();
+}
+
+// Converts the graph's adjacency matrix to a string representation.
+template <unsigned int Bits>
+std::string CBasicGraph<Bits>::ToString() const
+{
+    static const char hexDigits[] = "0123456789abcdef";
+
+    // Two hex digits per byte of the matrix
+    std::string str;
+    str.reserve(MAX_NODES * MAX_NODES / 4);
+
+    WriteAdjacencyMatrix([&str](const unsigned char* data, std::size_t size) {
+        for (std::size_t i = 0; i < size; ++i) {
+            str.push_back(hexDigits[data[i] >> 4]);
+            str.push_back(hexDigits[data[i] & 0x0F]);
+        }
+    });
+
     // Return hex representation.
-    return FormatHex(data);
+    return str;
 }
 
 // Dumps the graph's adjacency matrix to the console.
-void CGraph::Dump() const
+template <unsigned int Bits>
+void CBasicGraph<Bits>::Dump() const
 {
-    for (std::size_t i = 0; i < adjacencyMatrix.size(); ++i) {
-        for (std::size_t j = 0; j < adjacencyMatrix.size(); ++j) {
-            if (adjacencyMatrix[i].test(j)) {
-                printf("Edge: %zu -> %zu\n", i, j);
-            }
-        }
+    for (std::size_t from = occupancy._Find_first(); from < MAX_NODES; from = occupancy._Find_next(from)) {
+        printf("Edge: %zu -> %u\n", from, successors[from]);
     }
 }
 
 // Gets the total number of entries in the adjacency matrix.
-std::size_t CGraph::Size() const
+template <unsigned int Bits>
+std::size_t CBasicGraph<Bits>::Size() const
 {
-    std::size_t numNodes = adjacencyMatrix.size();
+    std::size_t numNodes = MAX_NODES;
     return numNodes * numNodes;
 }
 
 // Retrieves the adjacency matrix of the graph.
-const std::vector<std::bitset<MAX_NODES>>& CGraph::GetAdjacencyMatrix() const
+template <unsigned int Bits>
+std::vector<std::bitset<CBasicGraph<Bits>::MAX_NODES>> CBasicGraph<Bits>::GetAdjacencyMatrix() const
 {
+    std::vector<std::bitset<MAX_NODES>> adjacencyMatrix(MAX_NODES);
+
+    // Only the rows of the nodes with an outgoing edge hold a bit
+    for (std::size_t from = occupancy._Find_first(); from < MAX_NODES; from = occupancy._Find_next(from)) {
+        adjacencyMatrix[from].set(successors[from]);
+    }
+
     return adjacencyMatrix;
 }
 
+// Checks whether the graph contains the edge 'from' -> 'to'.
+template <unsigned int Bits>
+bool CBasicGraph<Bits>::HasEdge(uint16_t from, uint16_t to) const
+{
+    return from < MAX_NODES && occupancy.test(from) && successors[from] == to;
+}
+
+// Retrieves the successor of a node.
+template <unsigned int Bits>
+bool CBasicGraph<Bits>::GetSuccessor(uint16_t node, uint16_t& successor) const
+{
+    if (node >= MAX_NODES || !occupancy.test(node)) {
+        return false;
+    }
+
+    successor = successors[node];
+
+    return true;
+}
+
+// Retrieves the root nodes of the graph.
+template <unsigned int Bits>
+std::vector<uint16_t> CBasicGraph<Bits>::GetRoots() const
+{
+    std::vector<uint16_t> nodes;
+    nodes.reserve(roots.count());
+
+    for (std::size_t node = roots._Find_first(); node < MAX_NODES; node = roots._Find_next(node)) {
+        nodes.push_back(node);
+    }
+
+    return nodes;
+}
+
 // Retrieves the encrypted message.
-std::vector<unsigned char> CGraph::GetEncMessage() const
+template <unsigned int Bits>
+std::vector<unsigned char> CBasicGraph<Bits>::GetEncMessage() const
 {
     return enc;
 }
 
 // Retrieves the ciphertext used in the key encapsulation.
-std::vector<unsigned char> CGraph::GetCiphertext() const
+template <unsigned int Bits>
+std::vector<unsigned char> CBasicGraph<Bits>::GetCiphertext() const
 {
     return std::vector<unsigned char>(ciphertext, ciphertext + OQS_KEM_kyber_768_length_ciphertext);
 }
 
 // Retrieves the initialization vector used in encryption.
-std::vector<unsigned char> CGraph::GetIV() const
+template <unsigned int Bits>
+std::vector<unsigned char> CBasicGraph<Bits>::GetIV() const
 {
     return iv;
 }
 
 // Saves the adjacency matrix to a file
-bool CGraph::SaveAdjacencyMatrixToFile(const std::string& filename) const
+template <unsigned int Bits>
+bool CBasicGraph<Bits>::SaveAdjacencyMatrixToFile(const std::string& filename) const
 {
     std::ofstream outFile(filename, std::ios::binary);
     if (!outFile) {
@@ -428,27 +828,16 @@ bool CGraph::SaveAdjacencyMatrixToFile(const std::string& filename) const
         return false;
     }
 
-    // Write each bitset to the file
-    for (const auto& row : adjacencyMatrix) {
-        // Write the bitset as bytes
-        std::array<unsigned char, MAX_NODES / 8> rowBytes = {0};
+    // Write each row to the file
+    WriteAdjacencyMatrix([&outFile](const unsigned char* data, std::size_t size) {
+        outFile.write(reinterpret_cast<const char*>(data), size);
+    });
 
-        if (!row.none()) {
-            for (std::size_t i = 0; i < MAX_NODES; ++i) {
-                if (row[i]) {
-                    // Set the appropriate bit
-                    rowBytes[i / 8] |= (1 << (i % 8));
-                }
-            }
-        }
-
-        outFile.write(reinterpret_cast<const char*>(rowBytes.data()), rowBytes.size());
-        if (!outFile) {
-            fprintf(stderr, "ERROR: [%s] Failed to write nodes to file: %s\n", __func__, filename.c_str());
+    if (!outFile) {
+        fprintf(stderr, "ERROR: [%s] Failed to write nodes to file: %s\n", __func__, filename.c_str());
 
-            // Return false on failure
-            return false;
-        }
+        // Return false on failure
+        return false;
     }
 
     outFile.close();
@@ -458,11 +847,17 @@ bool CGraph::SaveAdjacencyMatrixToFile(const std::string& filename) const
 }
 
 // Function to set the number of threads
-void CGraph::SetNumThreads(unsigned int numThreads)
+template <unsigned int Bits>
+void CBasicGraph<Bits>::SetNumThreads(unsigned int numThreads)
 {
     // Ensure that the number of threads is valid (greater than 0 and less than or equal to the maximum allowed)
     assert(numThreads > 0 && numThreads <= std::thread::hardware_concurrency() && "Invalid number of threads!");
 
     // Set the number of threads
     nThreads = numThreads;
-}
\ No newline at end of file
+}
+
+template class CBasicGraph<10>;
+template class CBasicGraph<12>;
+template class CBasicGraph<14>;
+template class CBasicGraph<16>;
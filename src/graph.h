@@ -7,33 +7,85 @@
 
 // IWYU pragma: no_include <oqs/kem_kyber.h>
 
+#include <crypto.h>
+
+#include <array>
+#include <atomic>
 #include <bitset>
 #include <cstddef>
+#include <functional>
 #include <oqs/oqs.h> // IWYU pragma: keep
 #include <stdint.h>
 #include <string>
+#include <type_traits>
 #include <vector>
 
+/**
+ * @brief Number of bits of a node index in the consensus graph (CGraph).
+ */
+constexpr unsigned int NODE_BITS = 12;
+
 /**
  * @brief Maximum number of nodes allowed in the graph.
  *
  * Defines the maximum size of the graph's adjacency matrix, where each node can
  * be represented as a bit in a bitset. This limit is set to 4096 bits.
  */
-constexpr std::size_t MAX_NODES = 4096;
+constexpr std::size_t MAX_NODES = std::size_t(1) << NODE_BITS;
+
+/**
+ * @brief Graph digest over the full serialized adjacency matrix (MAX_NODES^2 bits).
+ *
+ * This is the original digest and the default of CGraph::GetHash().
+ */
+constexpr unsigned int GRAPH_DIGEST_V1 = 1;
+
+/**
+ * @brief Graph digest over a canonical edge list.
+ *
+ * The hashed data is the digest version and the number of bits of a node index,
+ * followed by every edge as a (from, to) pair in increasing 'from' order, all
+ * encoded as little-endian uint16_t. For a typical graph this is a few hundred
+ * bytes instead of 2 MiB.
+ */
+constexpr unsigned int GRAPH_DIGEST_V2 = 2;
+
+template <unsigned int Bits>
+class CBasicPath;
 
 /**
  * @brief Represents a graph with an adjacency matrix and cryptographic components.
+ *
+ * Every node has at most one outgoing edge, so the graph is stored as a
+ * successor array plus an occupancy bitmap (about 8 KiB) instead of a full
+ * MAX_NODES x MAX_NODES bit matrix (2 MiB). The adjacency matrix is only
+ * materialized on demand by GetAdjacencyMatrix().
+ *
+ * The graph is parameterized by the number of bits of a node index, which sets
+ * the number of nodes and how the encrypted data is split into node indices.
+ * It is explicitly instantiated for 10, 12, 14 and 16 bits; CGraph is the
+ * 12-bit consensus graph.
+ *
+ * @tparam Bits Number of bits of a node index (8 to 16).
  */
-class CGraph
+template <unsigned int Bits>
+class CBasicGraph
 {
-    friend class CPath;
+    static_assert(Bits >= 8 && Bits <= 16, "Node indices must fit in uint16_t");
+
+    friend class CBasicPath<Bits>;
 
 public:
+    ///< Number of bits of a node index.
+    static constexpr unsigned int NODE_BITS = Bits;
+
+    ///< Maximum number of nodes allowed in the graph.
+    static constexpr std::size_t MAX_NODES = std::size_t(1) << Bits;
+
     /**
-     * @brief Constructs an empty CGraph with an initialized adjacency matrix.
+     * @brief Constructs an empty graph.
      */
-    CGraph();
+    CBasicGraph();
 
     /**
      * @brief Adds an edge between two nodes in the graph.
@@ -55,6 +107,23 @@ public:
      */
     bool Initialize(const uint8_t* public_key, const uint8_t* secret_key);
 
+    /**
+     * @brief Initializes the graph with the keys of another graph.
+     *
+     * @param other The graph whose public and secret keys are copied.
+     *
+     * @return true if initialization is successful, false otherwise.
+     */
+    bool Initialize(const CBasicGraph<Bits>& other);
+
+    /**
+     * @brief Wipes the keys and drops the header, nonce, encrypted data, IV and ciphertext.
+     *
+     * The edges are kept; call Clear() to drop them too. Afterwards the graph holds
+     * nothing of its previous user, as if it had just been constructed.
+     */
+    void Wipe();
+
     void Clear();
 
     /**
@@ -71,6 +140,32 @@ public:
      */
     void SetNonce(const std::vector<unsigned char>& vch);
 
+    /**
+     * @brief Sets how many nonces share one key encapsulation in Generate().
+     *
+     * The ciphertext travels with the solution, so a miner may reuse one Kyber
+     * encapsulation and its shared secret for several nonces of the same header.
+     * Every IV is fresh unless fShareIV is set. The current encapsulation is
+     * dropped when the policy, the header or the keys change, and by Validate().
+     *
+     * While the key and IV stay the same, the CBC blocks covering the header do
+     * not change either: they are encrypted once into a midstate and every nonce
+     * only encrypts the blocks after them. This applies when fShareIV is set or
+     * a fixed IV was given with SetIV().
+     *
+     * @param numNonces Number of nonces per encapsulation: 1 (the default)
+     *                  encapsulates for every nonce, 0 once per header.
+     * @param fShareIV True to draw one IV per encapsulation instead of one per nonce.
+     */
+    void SetEncapsulationReuse(unsigned int numNonces, bool fShareIV = false);
+
+    /**
+     * @brief Sets a fixed initialization vector for Generate(), for deterministic testing and benchmarking.
+     *
+     * @param vch Vector containing the 16-byte IV, or an empty vector to go back to random IVs.
+     */
+    void SetIV(const std::vector<unsigned char>& vch);
+
     /**
      * @brief Encrypts the graph's data and updates the adjacency matrix with the encrypted data.
      *
@@ -92,6 +187,33 @@ public:
      */
     bool Validate(const std::vector<unsigned char>& solution);
 
+    /**
+     * @brief Checks that the encrypted data of a solution decrypts to the header and nonce.
+     *
+     * This is the cryptographic half of Validate(): it recovers the shared secret from the
+     * ciphertext, decrypts enc and compares it with header || nonce. It reads the solution
+     * only and leaves the graph untouched, so it may run while LoadSolution() builds the graph.
+     *
+     * @param solution The vector containing the encrypted data (enc), initialization vector (iv), and ciphertext.
+     * @param pfCancel Optional flag checked between decapsulation and decryption; when it is
+     *                 set the check stops and returns false.
+     *
+     * @return True if the data decrypts to header || nonce; false otherwise.
+     */
+    bool CheckEncryption(const std::vector<unsigned char>& solution, const std::atomic<bool>* pfCancel = nullptr) const;
+
+    /**
+     * @brief Builds the graph from the encrypted data of a solution.
+     *
+     * This is the structural half of Validate(): the edges only depend on enc, so the graph
+     * can be built and searched without waiting for CheckEncryption().
+     *
+     * @param solution The vector containing the encrypted data (enc), initialization vector (iv), and ciphertext.
+     *
+     * @return True if the graph was built; false if the solution has the wrong size.
+     */
+    bool LoadSolution(const std::vector<unsigned char>& solution);
+
     /**
      * @brief Dumps the graph's data for debugging purposes.
      */
@@ -114,16 +236,53 @@ public:
     /**
      * @brief Retrieves the adjacency matrix of the graph.
      *
-     * @return A constant reference to the adjacency matrix.
+     * The matrix is a compatibility view built from the successor array on
+     * every call, so the copy returned stays valid when the graph changes.
+     * Prefer HasEdge() and GetSuccessor() on hot paths. It takes MAX_NODES^2
+     * bits, that is 512 MiB with 16-bit node indices.
+     *
+     * @return A copy of the adjacency matrix.
+     */
+    std::vector<std::bitset<MAX_NODES>> GetAdjacencyMatrix() const;
+
+    /**
+     * @brief Checks whether the graph contains the edge 'from' -> 'to'.
+     *
+     * @param from The starting node.
+     * @param to The ending node.
+     *
+     * @return true if the edge exists, false otherwise.
+     */
+    bool HasEdge(uint16_t from, uint16_t to) const;
+
+    /**
+     * @brief Retrieves the successor of a node.
+     *
+     * @param node The node to look up.
+     * @param successor Receives the ending node of the outgoing edge, if any.
+     *
+     * @return true if the node has an outgoing edge, false otherwise.
+     */
+    bool GetSuccessor(uint16_t node, uint16_t& successor) const;
+
+    /**
+     * @brief Retrieves the root nodes of the graph.
+     *
+     * A root has an outgoing edge and no incoming one. The longest path always
+     * starts at a root, so these are the only useful DFS start nodes.
+     *
+     * @return A vector containing the root nodes in increasing order.
      */
-    const std::vector<std::bitset<MAX_NODES>>& GetAdjacencyMatrix() const;
+    std::vector<uint16_t> GetRoots() const;
 
     /**
      * @brief Computes the hash of the graph's adjacency matrix.
      *
-     * @return A vector containing the hash of the graph.
+     * @param version The digest format, GRAPH_DIGEST_V1 (full matrix) or GRAPH_DIGEST_V2 (edge list).
+     *
+     * @return A vector containing the hash of the graph, or an empty vector if the version is unknown.
      */
-    std::vector<unsigned char> GetHash() const;
+    std::vector<unsigned char> GetHash(unsigned int version = GRAPH_DIGEST_V1) const;
 
     /**
      * @brief Retrieves the encrypted message.
@@ -159,8 +318,17 @@ public:
     void SetNumThreads(unsigned int numThreads);
 
 private:
-    ///< Adjacency matrix of the graph.
-    std::vector<std::bitset<MAX_NODES>> adjacencyMatrix;
+    ///< Successor of each node, valid only where the occupancy bit is set.
+    std::array<uint16_t, MAX_NODES> successors;
+
+    ///< Occupancy bitmap of the nodes that have an outgoing edge.
+    std::bitset<MAX_NODES> occupancy;
+
+    ///< Number of edges entering each node, a node can have MAX_NODES of them.
+    std::array<std::conditional_t<(MAX_NODES > UINT16_MAX), uint32_t, uint16_t>, MAX_NODES> inDegree;
+
+    ///< Bitmap of the root nodes (outgoing edge, no incoming edge).
+    std::bitset<MAX_NODES> roots;
 
     ///< Header data.
     std::vector<unsigned char> header;
@@ -174,6 +342,9 @@ private:
     ///< Initialization vector.
     std::vector<unsigned char> iv;
 
+    ///< Caller-supplied IV used by Generate(), random IVs are used when empty.
+    std::vector<unsigned char> fixedIV;
+
     ///< Public key.
     uint8_t publicKey[OQS_KEM_kyber_768_length_public_key];
 
@@ -183,20 +354,135 @@ private:
     ///< Ciphertext.
     uint8_t ciphertext[OQS_KEM_kyber_768_length_ciphertext];
 
+    ///< Shared secret of the current encapsulation, valid while nEncapsulationUses > 0.
+    uint8_t sharedSecret[OQS_KEM_kyber_768_length_shared_secret];
+
+    ///< Nonces per encapsulation, 0 for once per header.
+    unsigned int nEncapsulationReuse = 1;
+
+    ///< Nonces that used the current encapsulation, 0 when there is none.
+    unsigned int nEncapsulationUses = 0;
+
+    ///< True to keep one IV for all the nonces of an encapsulation.
+    bool fEncapsulationShareIV = false;
+
+    ///< CBC state after the header blocks, valid for the current encapsulation.
+    CCBCMidstate headerMidstate;
+
+    ///< True while the graph is the checkpoint plus the edges in undoLog.
+    bool fCheckpoint = false;
+
+    ///< Leading data bytes the checkpoint was built from.
+    std::vector<unsigned char> checkpointPrefix;
+
+    ///< True if the checkpoint prefix ended with a node, which starts the next edge.
+    bool fCheckpointHaveFrom = false;
+
+    ///< Last node decoded from the checkpoint prefix.
+    uint16_t checkpointFrom = 0;
+
+    ///< Occupancy bitmap at the checkpoint.
+    std::bitset<MAX_NODES> checkpointOccupancy;
+
+    ///< Roots at the checkpoint.
+    std::bitset<MAX_NODES> checkpointRoots;
+
+    ///< Unique identifier of the checkpoint, lets a path cache what it derives from it.
+    uint64_t nCheckpointId = 0;
+
+    ///< Starting nodes of the edges added since the checkpoint, in insertion order.
+    std::vector<uint16_t> undoLog;
+
+    /**
+     * @brief Drops the current encapsulation and wipes its shared secret.
+     */
+    void ResetEncapsulation();
+
+    /**
+     * @brief Checks that a solution holds enc, iv and ciphertext and nothing else.
+     */
+    static bool CheckSolutionSize(const std::vector<unsigned char>& solution);
+
+    /**
+     * @brief Unpacks a solution of the right size into enc, iv and ciphertext.
+     */
+    void UnpackSolution(const std::vector<unsigned char>& solution);
+
+    /**
+     * @brief Checks that unpacked encrypted data decrypts to the header and nonce.
+     *
+     * @param solutionEnc The encrypted data (enc).
+     * @param solutionIV The initialization vector (iv).
+     * @param solutionCiphertext The Kyber-768 ciphertext.
+     * @param pfCancel Optional flag checked between decapsulation and decryption.
+     *
+     * @return True if the data decrypts to header || nonce; false otherwise.
+     */
+    bool CheckEncryption(const std::vector<unsigned char>& solutionEnc, const std::vector<unsigned char>& solutionIV, const uint8_t (&solutionCiphertext)[OQS_KEM_kyber_768_length_ciphertext], const std::atomic<bool>* pfCancel) const;
+
     /**
      * @brief Updates the graph using the decrypted data.
      *
      * This function is private and should not be called directly. It is used internally
      * by other methods like Generate and Validate to update the adjacency matrix with edges.
      *
+     * When the first bytes of the data are shared by the next calls (the header
+     * blocks of the encrypted message under a shared key and IV), the graph built
+     * from them is checkpointed. A later call with the same leading bytes rolls
+     * the edges added since the checkpoint back and only decodes the rest.
+     *
      * @param data The decrypted data used to update the graph.
+     * @param nSharedPrefix Number of leading bytes expected to repeat in the next calls, 0 for none.
      *
      * @return Returns true if the graph was updated successfully, false otherwise.
      */
-    bool UpdateGraphFromData(const std::vector<unsigned char>& data);
+    bool UpdateGraphFromData(const std::vector<unsigned char>& data, std::size_t nSharedPrefix = 0);
+
+    /**
+     * @brief Records an edge between two nodes known to be in range.
+     *
+     * Nodes that already have an outgoing edge are skipped, as in AddEdge().
+     *
+     * @param from The starting node.
+     * @param to The ending node.
+     */
+    void InsertEdge(uint16_t from, uint16_t to);
+
+    /**
+     * @brief Removes the edges added since the checkpoint.
+     */
+    void RollbackToCheckpoint();
+
+    /**
+     * @brief Forgets the checkpoint, the graph is kept as is.
+     */
+    void DropCheckpoint();
+
+    /**
+     * @brief Streams the serialized adjacency matrix row by row (MAX_NODES / 8 bytes per row).
+     *
+     * Only the rows set in the occupancy bitmap are built, using word-level
+     * find-first-set; every empty row is fed from a shared static zero block.
+     * Nothing is allocated, the matrix never exists in memory as a whole.
+     *
+     * @param sink Function called with each row, in order.
+     */
+    void WriteAdjacencyMatrix(const std::function<void(const unsigned char*, std::size_t)>& sink) const;
 
     // Number of threads to use for parallel processing.
     unsigned int nThreads = 1;
 };
 
+extern template class CBasicGraph<10>;
+extern template class CBasicGraph<12>;
+extern template class CBasicGraph<14>;
+extern template class CBasicGraph<16>;
+
+/**
+ * @brief The consensus graph, with 12-bit node indices.
+ */
+class CGraph : public CBasicGraph<NODE_BITS>
+{
+};
+
 #endif // QYRA_GRAPH_H
@@ -25,4 +25,29 @@ std::vector<unsigned char> CHasher::BLAKE3(const std::vector<unsigned char>& dat
 
     // Return the hash as a vector of unsigned characters
     return std::vector<unsigned char>(hash, hash + BLAKE3_OUT_LEN);
-}
\ No newline at end of file
+}
+
+// Constructs a writer with an empty input.
+CHashWriter::CHashWriter()
+{
+    blake3_hasher_init(&hasher);
+}
+
+// Appends bytes to the hashed input.
+void CHashWriter::Write(const unsigned char* data, std::size_t size)
+{
+    blake3_hasher_update(&hasher, data, size);
+}
+
+// Computes the hash of the bytes written so far.
+std::vector<unsigned char> CHashWriter::Finalize() const
+{
+    // Buffer to store the hash output
+    unsigned char hash[BLAKE3_OUT_LEN];
+
+    // Finalizing does not modify the hasher, more data may still be written
+    blake3_hasher_finalize(&hasher, hash, sizeof(hash));
+
+    // Return the hash as a vector of unsigned characters
+    return std::vector<unsigned char>(hash, hash + BLAKE3_OUT_LEN);
+}
@@ -5,6 +5,8 @@
 #ifndef QYRA_HASH_H
 #define QYRA_HASH_H
 
+#include <blake3.h>
+#include <cstddef>
 #include <vector>
 
 /**
@@ -23,4 +25,38 @@ public:
     static std::vector<unsigned char> BLAKE3(const std::vector<unsigned char>& data);
 };
 
+/**
+ * @brief Computes a BLAKE3 hash incrementally, without buffering the input.
+ *
+ * Writing the data in several pieces gives the same hash as CHasher::BLAKE3()
+ * over their concatenation.
+ */
+class CHashWriter
+{
+public:
+    /**
+     * @brief Constructs a writer with an empty input.
+     */
+    CHashWriter();
+
+    /**
+     * @brief Appends bytes to the hashed input.
+     *
+     * @param data Pointer to the bytes to append.
+     * @param size Number of bytes to append.
+     */
+    void Write(const unsigned char* data, std::size_t size);
+
+    /**
+     * @brief Computes the hash of the bytes written so far.
+     *
+     * @return A vector containing the BLAKE3 hash.
+     */
+    std::vector<unsigned char> Finalize() const;
+
+private:
+    ///< BLAKE3 hasher state.
+    blake3_hasher hasher;
+};
+
 #endif // QYRA_HASH_H
\ No newline at end of file
@@ -7,6 +7,7 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <span>
 #include <string>
 #include <vector>
 
@@ -34,13 +35,15 @@
  *
  * The encrypted version of this 140-byte plaintext will always be 144 bytes due to padding.
  */
-#define ENC_SIZE 144         ///< Size of encrypted data
-#define IV_SIZE 16           ///< Size of initialization vector (AES_BLOCK_SIZE)
-#define CIPHERTEXT_SIZE 1088 ///< Size of ciphertext for Kyber768
-#define HASH_SIZE 32         ///< Size of hash
+constexpr std::size_t HEADER_SIZE = 108;      ///< Size of the block header
+constexpr std::size_t NONCE_SIZE = 32;        ///< Size of the nonce
+constexpr std::size_t IV_SIZE = 16;           ///< Size of initialization vector (AES_BLOCK_SIZE)
+constexpr std::size_t CIPHERTEXT_SIZE = 1088; ///< Size of ciphertext for Kyber768
+constexpr std::size_t HASH_SIZE = 32;         ///< Size of hash
 
-#define TOTAL_SIZE (ENC_SIZE + IV_SIZE + CIPHERTEXT_SIZE) ///< Define total size for the combined vector
-#define SOLUTION_SIZE (TOTAL_SIZE + HASH_SIZE)            ///< Define total size for the solution vector including the hash
+constexpr std::size_t ENC_SIZE = (HEADER_SIZE + NONCE_SIZE) / IV_SIZE * IV_SIZE + IV_SIZE; ///< Size of encrypted data (PKCS#7 padding)
+constexpr std::size_t TOTAL_SIZE = ENC_SIZE + IV_SIZE + CIPHERTEXT_SIZE;                  ///< Define total size for the combined vector
+constexpr std::size_t SOLUTION_SIZE = TOTAL_SIZE + HASH_SIZE;                             ///< Define total size for the solution vector including the hash
 
 /**
  * @class CGraph
@@ -59,6 +62,14 @@ class CGraph;
  */
 class CPath;
 
+/**
+ * @struct CWorkspace
+ * @brief Forward declaration of the CWorkspace structure.
+ *
+ * A graph and a path taken from the shared workspace pool.
+ */
+struct CWorkspace;
+
 /**
  * @namespace LibQYRA
  * @brief A namespace for the LibQYRA library.
@@ -81,6 +92,77 @@ public:
     std::vector<unsigned char> hash;       ///< Hash of the data.
 };
 
+/**
+ * @brief CKEMPoolStats reports the state of the background encapsulation pool.
+ */
+class CKEMPoolStats
+{
+public:
+    std::size_t depth = 0;      ///< Capacity of the pool, zero when it is stopped.
+    unsigned int producers = 0; ///< Number of producer threads running.
+    std::size_t available = 0;  ///< Encapsulations ready to be taken.
+    uint64_t produced = 0;      ///< Encapsulations produced since the pool was started.
+    uint64_t taken = 0;         ///< Encapsulations taken by mining threads.
+    uint64_t misses = 0;        ///< Times a mining thread found the pool empty and encapsulated itself.
+};
+
+/**
+ * @brief Outcome of a staged validation.
+ */
+enum class ValidationResult {
+    VALID,              ///< The solution passed every stage.
+    INVALID_SIZE,       ///< The solution is too short to hold enc, iv, ciphertext and hash.
+    INVALID_ENCRYPTION, ///< The encrypted data does not decrypt to the header and nonce.
+    INVALID_PATH,       ///< The hash does not match the longest path of the graph.
+    BUDGET_EXHAUSTED,   ///< The work budget ran out before the solution was fully checked.
+};
+
+/**
+ * @brief CValidationBudget limits the work spent validating the solutions of one peer.
+ *
+ * Costs are measured in nanoseconds of validation time. The caller keeps one budget
+ * per peer and refills it as it sees fit.
+ */
+class CValidationBudget
+{
+public:
+    uint64_t remaining = 0; ///< Work left, in nanoseconds.
+    uint64_t spent = 0;     ///< Work charged so far, in nanoseconds.
+};
+
+/**
+ * @brief CValidationItem is a solution to validate together with the header and nonce it was mined for.
+ */
+class CValidationItem
+{
+public:
+    std::vector<unsigned char> header;   ///< Block header the solution was mined for.
+    std::vector<unsigned char> nonce;    ///< Nonce the solution was mined for.
+    std::vector<unsigned char> solution; ///< Solution vector containing enc, iv, ciphertext and the path hash.
+};
+
+/**
+ * @brief CValidationStageStats reports the measured cost of a validation stage.
+ */
+class CValidationStageStats
+{
+public:
+    uint64_t runs = 0;        ///< Number of times the stage ran.
+    uint64_t rejects = 0;     ///< Number of solutions the stage rejected.
+    uint64_t averageCost = 0; ///< Moving average of the stage cost, in nanoseconds.
+};
+
+/**
+ * @brief CValidationStats reports the measured cost of every validation stage.
+ */
+class CValidationStats
+{
+public:
+    CValidationStageStats structure;  ///< Size and layout checks.
+    CValidationStageStats encryption; ///< Kyber-768 decapsulation and AES decryption.
+    CValidationStageStats path;       ///< Graph build, longest path search and path hash.
+};
+
 /**
  * @brief CSolutionData manages solution-related data.
  */
@@ -168,6 +250,61 @@ public:
      */
     QYRA_API void EnableParallelDFS();
 
+    /**
+     * @brief Sets the number of worker threads of the pool shared by all instances.
+     *
+     * The pool is started lazily by the first parallel search and shut down when
+     * the last CQYRA instance is destroyed. It may be called while searches are
+     * running, the workers are then replaced once the last of them returns.
+     *
+     * @param numThreads Number of worker threads, or zero for one less than the
+     *                   number of cores (the calling thread also runs tasks).
+     */
+    QYRA_API static void SetWorkerThreads(unsigned int numThreads);
+
+    /**
+     * @brief Preallocates the graph and path workspaces shared by all instances.
+     *
+     * Every instance takes a workspace from a shared pool and gives it back when
+     * destroyed. Reserving them up front faults their memory in once, so creating
+     * instances and processing nonces later never allocates.
+     *
+     * @param count Number of workspaces that must be available.
+     * @param fHugePages True to back the new workspaces with transparent huge pages, where supported.
+     */
+    QYRA_API static void ReserveWorkspaces(std::size_t count, bool fHugePages = false);
+
+    /**
+     * @brief Starts background threads that precompute Kyber-768 encapsulations.
+     *
+     * Mining threads take a ready (ciphertext, shared secret) pair from the pool
+     * instead of encapsulating themselves, and only fall back to encapsulating
+     * when the pool is empty. The pool serves a single public key; instances
+     * initialized with another key are not affected. Calling it again restarts
+     * the pool. Searches running meanwhile encapsulate themselves until it is ready.
+     *
+     * @param public_key The public key the encapsulations are made against.
+     * @param depth Number of encapsulations kept ready, rounded up to a power of two.
+     * @param numProducers Number of producer threads.
+     *
+     * @return True if the pool was started, false if a parameter is invalid.
+     */
+    QYRA_API static bool StartKEMPool(const uint8_t* public_key, std::size_t depth, unsigned int numProducers);
+
+    /**
+     * @brief Stops the background encapsulation pool and wipes the pending shared secrets.
+     *
+     * Searches running meanwhile go back to encapsulating themselves.
+     */
+    QYRA_API static void StopKEMPool();
+
+    /**
+     * @brief Reports the state of the background encapsulation pool.
+     *
+     * @return The pool depth, producer count and counters.
+     */
+    QYRA_API static CKEMPoolStats GetKEMPoolStats();
+
     /**
      * @brief Sets the header data.
      *
@@ -175,6 +312,24 @@ public:
      */
     QYRA_API void SetHeader(const std::vector<unsigned char>& vch);
 
+    /**
+     * @brief Sets how many nonces share one key encapsulation while mining.
+     *
+     * A Kyber-768 encapsulation is one of the most expensive steps of Mine().
+     * Its ciphertext is part of the solution, so one encapsulation may serve
+     * several nonces of the same header, each encrypted with a fresh IV by default.
+     * A new encapsulation is made when the header or the keys change.
+     *
+     * Sharing the IV too keeps the CBC blocks of the header identical for all the
+     * nonces of an encapsulation, so they are encrypted once and each nonce only
+     * encrypts its own blocks.
+     *
+     * @param numNonces Number of nonces per encapsulation: 1 (the default)
+     *                  encapsulates for every nonce, 0 once per header.
+     * @param fShareIV True to draw one IV per encapsulation instead of one per nonce.
+     */
+    QYRA_API void SetEncapsulationReuse(unsigned int numNonces, bool fShareIV = false);
+
     /**
      * @brief Sets the nonce used in the mining process.
      *
@@ -187,7 +342,8 @@ public:
      *
      * This function verifies the correctness of the solution by validating the graph and path components.
      * It uses the provided solution vector to ensure that the graph is correctly generated and the path is
-     * correctly computed based on the validated graph.
+     * correctly computed based on the validated graph. The checks always run in the
+     * same order and leave the measurements used by ValidateStaged() untouched.
      *
      * @param vch The solution vector containing only the encrypted data (enc), initialization vector (iv),
      *            and ciphertext. The hash is not included in this vector.
@@ -196,6 +352,65 @@ public:
      */
     QYRA_API bool Validate(const std::vector<unsigned char>& vch) const;
 
+    /**
+     * @brief Validates a solution in stages, cheapest first, within an optional work budget.
+     *
+     * The structural checks run first and cost next to nothing, they are counted
+     * but neither timed nor charged. The encryption check
+     * (Kyber-768 decapsulation and AES decryption) and the path check (graph build,
+     * longest path search and path hash) are independent; the one with the lower
+     * measured average cost runs first, so most invalid solutions are rejected by
+     * the cheaper one alone. Both are timed and their cost is charged to the
+     * budget. A stage whose average cost exceeds what is left of the budget is not
+     * started, and neither is any stage once the budget is empty. Until a stage has
+     * been measured, a conservative default cost is assumed.
+     *
+     * @param vch The solution vector containing enc, iv, ciphertext and the path hash.
+     * @param budget The work budget of the peer that sent the solution, or nullptr for none.
+     *
+     * @return VALID if every stage passed, otherwise the first stage that failed or
+     *         BUDGET_EXHAUSTED.
+     */
+    QYRA_API ValidationResult ValidateStaged(const std::vector<unsigned char>& vch, CValidationBudget* budget = nullptr) const;
+
+    /**
+     * @brief Validates a batch of solutions in parallel on the shared worker pool.
+     *
+     * A single graph search is too small to keep many threads busy, so the batch is
+     * spread across solutions instead: each task takes its own workspace from the
+     * shared pool, initialized with the keys of this instance, and validates items
+     * in stages, as ValidateStaged() does, until none is left. The header and nonce
+     * of this instance are not used.
+     *
+     * @param items The solutions to validate, each with its header and nonce.
+     * @param results Receives the verdict of each item, in the order of items.
+     *
+     * @return True if the batch was validated, false if the spans differ in size or
+     *         the workspaces cannot be initialized.
+     *
+     * @throws std::bad_alloc If the workspaces cannot be allocated.
+     */
+    QYRA_API bool ValidateBatch(std::span<const CValidationItem> items, std::span<ValidationResult> results) const;
+
+    /**
+     * @brief Reports the measured cost of every validation stage, across all instances.
+     *
+     * @return The runs, rejects and average cost of each stage.
+     */
+    QYRA_API static CValidationStats GetValidationStats();
+
+    /**
+     * @brief Enables validating the encryption and the path of a solution at the same time.
+     *
+     * The graph is built from the encrypted data alone, so the Kyber-768 decapsulation
+     * and AES decryption do not have to finish before the graph search starts. When
+     * enabled, Validate() runs both checks on the shared worker pool and the first one
+     * to fail makes the other stop at its next step. Disabled by default.
+     *
+     * @param fEnable True to run the two checks concurrently, false to run them in turn.
+     */
+    QYRA_API void SetConcurrentValidation(bool fEnable);
+
     /**
      * @brief Starts the mining process to find a solution to the graph.
      *
@@ -213,8 +428,21 @@ public:
     CSolutionData solution; ///< Holds the current solution data.
 
 private:
-    CGraph* graph; ///< Pointer to the graph used in the mining process.
-    CPath* path;   ///< Pointer to the path used for solving the graph.
+    CWorkspace* workspace; ///< Workspace holding the graph and path, owned by the shared pool.
+    CGraph* graph;         ///< Pointer to the graph used in the mining process.
+    CPath* path;           ///< Pointer to the path used for solving the graph.
+
+    bool fConcurrentValidation; ///< True to validate the encryption and the path concurrently.
+
+    /**
+     * @brief Runs the encryption check and the graph and path check at the same time.
+     *
+     * @param graphData The encrypted data (enc), initialization vector (iv), and ciphertext.
+     * @param pathHash The expected hash of the path.
+     *
+     * @return True if both checks pass; false otherwise.
+     */
+    bool ValidateConcurrently(const std::vector<unsigned char>& graphData, const std::vector<unsigned char>& pathHash) const;
 };
 
 } // namespace LibQYRA
@@ -0,0 +1,313 @@
+// Copyright (c) 2024 Marco Fortina
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#include <kempool.h>
+
+#include <crypto.h>
+
+#include <algorithm>
+#include <cstring>
+#include <openssl/crypto.h>
+#include <stdio.h>
+
+// Retrieves the pool shared by the whole library.
+CKEMPool& CKEMPool::Get()
+{
+    static CKEMPool pool;
+    return pool;
+}
+
+// Initializes OpenSSL before the pool, so the pool is destroyed before OpenSSL is cleaned up at exit.
+CKEMPool::CKEMPool()
+{
+    OPENSSL_init_crypto(0, nullptr);
+}
+
+// Stops the producers and destroys the pool.
+CKEMPool::~CKEMPool()
+{
+    Stop();
+}
+
+// Allocates an empty ring.
+CKEMPool::CRing::CRing(std::size_t size) : cells(new CCell[size]), nMask(size - 1)
+{
+    for (std::size_t i = 0; i < size; ++i) {
+        cells[i].nSequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+// Wipes the shared secrets left in the cells.
+CKEMPool::CRing::~CRing()
+{
+    for (std::size_t i = 0; i <= nMask; ++i) {
+        OPENSSL_cleanse(cells[i].sharedSecret, sizeof(cells[i].sharedSecret));
+    }
+}
+
+// Starts producing encapsulations for a public key, restarting the pool if it is running.
+bool CKEMPool::Start(const uint8_t* public_key, std::size_t depth, unsigned int numProducers)
+{
+    // Check if public_key is null
+    if (!public_key) {
+        fprintf(stderr, "ERROR: [%s] Invalid public_key: pointer is null.\n", __func__);
+        return false;
+    }
+
+    // Check the pool parameters
+    if (depth == 0 || numProducers == 0) {
+        fprintf(stderr, "ERROR: [%s] Invalid pool parameters: depth=%zu, producers=%u.\n", __func__, depth, numProducers);
+        return false;
+    }
+
+    Stop();
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // Round the depth up to a power of two, so positions map to cells with a mask;
+    // the sequence numbers need two cells at least to tell the laps apart
+    std::size_t size = 2;
+    while (size < depth) {
+        size <<= 1;
+    }
+
+    // Reuse the ring of this size, a Take() still running on it from an earlier
+    // generation discards what it pops; rings are only freed with the pool
+    auto it = std::find_if(rings.begin(), rings.end(), [size](const std::unique_ptr<CRing>& r) { return r->nMask + 1 == size; });
+    if (it == rings.end()) {
+        rings.push_back(std::make_unique<CRing>(size));
+        it = rings.end() - 1;
+    }
+    CRing* newRing = it->get();
+
+    nProduced.store(0, std::memory_order_relaxed);
+    nTaken.store(0, std::memory_order_relaxed);
+    nMisses.store(0, std::memory_order_relaxed);
+
+    // The pool is stopped, no Take() can confirm a match while the key is rewritten
+    for (std::size_t i = 0; i < PUBLIC_KEY_WORDS; ++i) {
+        uint64_t word;
+        std::memcpy(&word, public_key + i * sizeof(word), sizeof(word));
+        publicKey[i].store(word, std::memory_order_relaxed);
+    }
+
+    // Publish the ring and key before Take() may see the new generation running
+    ring.store(newRing, std::memory_order_relaxed);
+    uint64_t generation = nGeneration.fetch_add(1, std::memory_order_release) + 1;
+    fRunning.store(true, std::memory_order_release);
+
+    std::vector<uint8_t> key(public_key, public_key + OQS_KEM_kyber_768_length_public_key);
+
+    producers.reserve(numProducers);
+    for (unsigned int i = 0; i < numProducers; ++i) {
+        producers.emplace_back(&CKEMPool::ProducerThread, this, newRing, generation, key);
+    }
+
+    return true;
+}
+
+// Stops the producers and wipes the encapsulations left in the ring.
+void CKEMPool::Stop()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // Take() calls from now on see no ring; those in flight see the generation change
+    fRunning.store(false);
+    nGeneration.fetch_add(1);
+    CRing* oldRing = ring.exchange(nullptr);
+
+    // Wake up the producers waiting for a free cell
+    nPops.fetch_add(1);
+    nPops.notify_all();
+
+    for (auto& producer : producers) {
+        producer.join();
+    }
+    producers.clear();
+
+    if (!oldRing) {
+        return;
+    }
+
+    // Drain the ring as a consumer, so it is empty when it is reused
+    uint8_t ciphertext[OQS_KEM_kyber_768_length_ciphertext];
+    uint8_t sharedSecret[OQS_KEM_kyber_768_length_shared_secret];
+    uint64_t generation;
+    while (oldRing->Pop(ciphertext, sharedSecret, generation)) {
+    }
+    OPENSSL_cleanse(sharedSecret, sizeof(sharedSecret));
+}
+
+// Pushes an encapsulation into the ring.
+bool CKEMPool::CRing::Push(const uint8_t* ciphertext, const uint8_t* shared_secret, uint64_t nGeneration)
+{
+    std::size_t pos = nEnqueuePos.load(std::memory_order_relaxed);
+
+    while (true) {
+        CCell& cell = cells[pos & nMask];
+        std::size_t seq = cell.nSequence.load(std::memory_order_acquire);
+        std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+
+        if (diff == 0) {
+            // The cell is free for this position, claim it
+            if (nEnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                cell.nGeneration = nGeneration;
+                std::memcpy(cell.ciphertext, ciphertext, sizeof(cell.ciphertext));
+                std::memcpy(cell.sharedSecret, shared_secret, sizeof(cell.sharedSecret));
+                cell.nSequence.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            // The cell still holds the encapsulation of the previous lap
+            return false;
+        } else {
+            // Another producer claimed this position
+            pos = nEnqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+// Pops an encapsulation from the ring and wipes its cell.
+bool CKEMPool::CRing::Pop(uint8_t* ciphertext, uint8_t* shared_secret, uint64_t& nGeneration)
+{
+    std::size_t pos = nDequeuePos.load(std::memory_order_relaxed);
+
+    while (true) {
+        CCell& cell = cells[pos & nMask];
+        std::size_t seq = cell.nSequence.load(std::memory_order_acquire);
+        std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+
+        if (diff == 0) {
+            // The cell holds data for this position, claim it
+            if (nDequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                nGeneration = cell.nGeneration;
+                std::memcpy(ciphertext, cell.ciphertext, sizeof(cell.ciphertext));
+                std::memcpy(shared_secret, cell.sharedSecret, sizeof(cell.sharedSecret));
+                OPENSSL_cleanse(cell.sharedSecret, sizeof(cell.sharedSecret));
+                cell.nSequence.store(pos + nMask + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            // Nothing produced for this position yet
+            return false;
+        } else {
+            // Another consumer claimed this position
+            pos = nDequeuePos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+// Main loop of a producer thread.
+void CKEMPool::ProducerThread(CRing* ring, uint64_t nGeneration, std::vector<uint8_t> public_key)
+{
+    uint8_t ciphertext[OQS_KEM_kyber_768_length_ciphertext];
+    uint8_t sharedSecret[OQS_KEM_kyber_768_length_shared_secret];
+
+    while (fRunning.load()) {
+        if (!CCrypter::GenerateCiphertext(ciphertext, sharedSecret, public_key.data())) {
+            // Mining threads fall back to encapsulating themselves
+            break;
+        }
+
+        while (true) {
+            // Read the pop counter before checking, so a pop or Stop() in between ends the wait
+            uint32_t nSeen = nPops.load();
+
+            if (!fRunning.load()) {
+                break;
+            }
+
+            if (ring->Push(ciphertext, sharedSecret, nGeneration)) {
+                nProduced.fetch_add(1, std::memory_order_relaxed);
+                break;
+            }
+
+            // The ring is full, sleep until a cell is freed
+            nPops.wait(nSeen);
+        }
+    }
+
+    OPENSSL_cleanse(sharedSecret, sizeof(sharedSecret));
+}
+
+// Checks a public key against the one of the pool.
+bool CKEMPool::MatchesPublicKey(const uint8_t* public_key) const
+{
+    for (std::size_t i = 0; i < PUBLIC_KEY_WORDS; ++i) {
+        uint64_t word;
+        std::memcpy(&word, public_key + i * sizeof(word), sizeof(word));
+        if (publicKey[i].load(std::memory_order_relaxed) != word) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Takes a precomputed encapsulation for a public key.
+bool CKEMPool::Take(uint8_t* ciphertext, uint8_t* shared_secret, const uint8_t* public_key)
+{
+    // Mining without a pool costs a single atomic load per encapsulation
+    if (!fRunning.load(std::memory_order_acquire)) {
+        return false;
+    }
+
+    uint64_t generation = nGeneration.load(std::memory_order_acquire);
+    CRing* current = ring.load(std::memory_order_relaxed);
+    if (!current) {
+        return false;
+    }
+
+    // Encapsulations made against another public key are useless to this caller
+    bool fMatch = MatchesPublicKey(public_key);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (!fMatch || nGeneration.load(std::memory_order_relaxed) != generation) {
+        return false;
+    }
+
+    uint64_t produced;
+    if (!current->Pop(ciphertext, shared_secret, produced)) {
+        nMisses.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    // A cell was freed, wake up a producer
+    nPops.fetch_add(1);
+    nPops.notify_one();
+
+    // The pool was restarted under us, the encapsulation may be for another key
+    if (produced != generation) {
+        OPENSSL_cleanse(shared_secret, OQS_KEM_kyber_768_length_shared_secret);
+        nMisses.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    nTaken.fetch_add(1, std::memory_order_relaxed);
+
+    return true;
+}
+
+// Gets the counters describing the pool.
+CKEMPool::CStats CKEMPool::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    CStats stats;
+
+    CRing* current = ring.load();
+    if (current) {
+        std::size_t nEnqueued = current->nEnqueuePos.load();
+        std::size_t nDequeued = current->nDequeuePos.load();
+
+        stats.nDepth = current->nMask + 1;
+        stats.nProducers = producers.size();
+        stats.nAvailable = nEnqueued > nDequeued ? nEnqueued - nDequeued : 0;
+    }
+
+    stats.nProduced = nProduced.load();
+    stats.nTaken = nTaken.load();
+    stats.nMisses = nMisses.load();
+
+    return stats;
+}
@@ -0,0 +1,238 @@
+// Copyright (c) 2024 Marco Fortina
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#ifndef QYRA_KEMPOOL_H
+#define QYRA_KEMPOOL_H
+
+// IWYU pragma: no_include <oqs/kem_kyber.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <oqs/oqs.h> // IWYU pragma: keep
+#include <thread>
+#include <vector>
+
+/**
+ * @brief A pool of Kyber-768 encapsulations precomputed by background threads.
+ *
+ * Producer threads encapsulate against one public key and push the resulting
+ * (ciphertext, shared secret) pairs into a bounded lock-free ring. Generate()
+ * takes a pair from the ring instead of encapsulating on the mining thread,
+ * and falls back to encapsulating itself when the ring is empty or was filled
+ * for another public key. Producers sleep while the ring is full.
+ *
+ * Rings live as long as the pool, one per size, so Take() never waits for a
+ * lock nor touches a shared reference count. A restart bumps a generation
+ * counter instead of freeing anything: every cell is stamped with the
+ * generation that produced it, and a Take() overtaken by a restart discards
+ * what it popped.
+ */
+class CKEMPool
+{
+public:
+    /**
+     * @brief Counters describing the pool.
+     */
+    struct CStats {
+        ///< Capacity of the ring.
+        std::size_t nDepth = 0;
+
+        ///< Number of producer threads running.
+        unsigned int nProducers = 0;
+
+        ///< Encapsulations waiting in the ring.
+        std::size_t nAvailable = 0;
+
+        ///< Encapsulations produced since the pool was started.
+        uint64_t nProduced = 0;
+
+        ///< Encapsulations taken from the ring since the pool was started.
+        uint64_t nTaken = 0;
+
+        ///< Take() calls that found the ring empty since the pool was started.
+        uint64_t nMisses = 0;
+    };
+
+    /**
+     * @brief Retrieves the pool shared by the whole library.
+     *
+     * @return A reference to the shared pool.
+     */
+    static CKEMPool& Get();
+
+    /**
+     * @brief Stops the producers and destroys the pool.
+     */
+    ~CKEMPool();
+
+    CKEMPool(const CKEMPool&) = delete;
+    CKEMPool& operator=(const CKEMPool&) = delete;
+
+    /**
+     * @brief Starts producing encapsulations for a public key, restarting the pool if it is running.
+     *
+     * @param public_key The public key to encapsulate against.
+     * @param depth Number of encapsulations kept ready, rounded up to a power of two (2 at least).
+     * @param numProducers Number of producer threads.
+     *
+     * @return true if the pool was started, false if a parameter is invalid.
+     */
+    bool Start(const uint8_t* public_key, std::size_t depth, unsigned int numProducers);
+
+    /**
+     * @brief Stops the producers and wipes the encapsulations left in the ring.
+     */
+    void Stop();
+
+    /**
+     * @brief Takes a precomputed encapsulation for a public key.
+     *
+     * @param ciphertext A pointer to a buffer where the ciphertext will be stored.
+     * @param shared_secret A pointer to a buffer where the shared secret will be stored.
+     * @param public_key The public key the encapsulation must have been made against.
+     *
+     * @return true if an encapsulation was taken, false if the pool is stopped, serves
+     *         another public key or is empty.
+     */
+    bool Take(uint8_t* ciphertext, uint8_t* shared_secret, const uint8_t* public_key);
+
+    /**
+     * @brief Gets the counters describing the pool.
+     *
+     * @return A snapshot of the counters.
+     */
+    CStats GetStats() const;
+
+private:
+    /**
+     * @brief A slot of the ring.
+     *
+     * The sequence number tells producers and consumers whose turn it is, as in
+     * Dmitry Vyukov's bounded MPMC queue.
+     */
+    struct CCell {
+        ///< Ring position this cell is ready for, offset by one once it holds data.
+        std::atomic<std::size_t> nSequence;
+
+        ///< Generation of the pool the encapsulation was produced in.
+        uint64_t nGeneration;
+
+        ///< Ciphertext of the encapsulation.
+        uint8_t ciphertext[OQS_KEM_kyber_768_length_ciphertext];
+
+        ///< Shared secret of the encapsulation.
+        uint8_t sharedSecret[OQS_KEM_kyber_768_length_shared_secret];
+    };
+
+    /**
+     * @brief A bounded ring of encapsulations, kept until the pool is destroyed.
+     */
+    struct CRing {
+        ///< Cells of the ring.
+        std::unique_ptr<CCell[]> cells;
+
+        ///< Capacity of the ring minus one, the ring size is a power of two.
+        std::size_t nMask = 0;
+
+        ///< Next ring position to be written.
+        alignas(64) std::atomic<std::size_t> nEnqueuePos{0};
+
+        ///< Next ring position to be read.
+        alignas(64) std::atomic<std::size_t> nDequeuePos{0};
+
+        /**
+         * @brief Allocates an empty ring.
+         *
+         * @param size Number of cells, a power of two.
+         */
+        explicit CRing(std::size_t size);
+
+        /**
+         * @brief Wipes the shared secrets left in the cells.
+         */
+        ~CRing();
+
+        /**
+         * @brief Pushes an encapsulation into the ring.
+         *
+         * @param nGeneration Generation of the pool the encapsulation was produced in.
+         *
+         * @return true if it was pushed, false if the ring is full.
+         */
+        bool Push(const uint8_t* ciphertext, const uint8_t* shared_secret, uint64_t nGeneration);
+
+        /**
+         * @brief Pops an encapsulation from the ring and wipes its cell.
+         *
+         * @param nGeneration Set to the generation the encapsulation was produced in.
+         *
+         * @return true if one was popped, false if the ring is empty.
+         */
+        bool Pop(uint8_t* ciphertext, uint8_t* shared_secret, uint64_t& nGeneration);
+    };
+
+    ///< Number of 64-bit words of a public key.
+    static constexpr std::size_t PUBLIC_KEY_WORDS = OQS_KEM_kyber_768_length_public_key / sizeof(uint64_t);
+    static_assert(OQS_KEM_kyber_768_length_public_key % sizeof(uint64_t) == 0, "The public key must be made of whole words");
+
+    CKEMPool();
+
+    /**
+     * @brief Main loop of a producer thread.
+     *
+     * @param ring The ring to fill.
+     * @param nGeneration Generation of the pool the producer was started for.
+     * @param public_key The public key to encapsulate against, owned by the producer.
+     */
+    void ProducerThread(CRing* ring, uint64_t nGeneration, std::vector<uint8_t> public_key);
+
+    /**
+     * @brief Checks a public key against the one of the pool.
+     *
+     * The caller confirms afterwards that the generation did not change while comparing.
+     *
+     * @param public_key The public key to check.
+     *
+     * @return true if the words read match the public key.
+     */
+    bool MatchesPublicKey(const uint8_t* public_key) const;
+
+    ///< Serializes Start(), Stop() and GetStats(), Take() never takes it.
+    mutable std::mutex mutex;
+
+    ///< Producer threads.
+    std::vector<std::thread> producers;
+
+    ///< Every ring allocated so far, at most one per size (mutex must be held).
+    std::vector<std::unique_ptr<CRing>> rings;
+
+    ///< Ring of the running pool, null while it is stopped.
+    std::atomic<CRing*> ring{nullptr};
+
+    ///< Public key the producers encapsulate against, only rewritten while the pool is stopped.
+    std::atomic<uint64_t> publicKey[PUBLIC_KEY_WORDS] = {};
+
+    ///< Bumped by Start() and Stop(), tells Take() its ring or public key may have changed.
+    alignas(64) std::atomic<uint64_t> nGeneration{0};
+
+    ///< True while producers are running and Take() may use the ring.
+    std::atomic<bool> fRunning{false};
+
+    ///< Bumped on every pop and on Stop(), producers wait on it while the ring is full.
+    alignas(64) std::atomic<uint32_t> nPops{0};
+
+    ///< Encapsulations produced.
+    std::atomic<uint64_t> nProduced{0};
+
+    ///< Encapsulations taken.
+    std::atomic<uint64_t> nTaken{0};
+
+    ///< Take() calls that found the ring empty.
+    std::atomic<uint64_t> nMisses{0};
+};
+
+#endif // QYRA_KEMPOOL_H
@@ -7,27 +7,37 @@
 #include <graph.h>
 #include <hash.h>
 #include <stream.h>
+#include <threadpool.h>
 #include <utils.h>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <bitset>
 #include <cstdio>
 #include <fstream>
 #include <iostream>
-#include <mutex>
 #include <thread>
 
-// Constructs a CPath from a set of nodes.
-CPath::CPath(const std::vector<uint16_t>& nodes) : nodes(nodes) {}
+// Constructs an empty path.
+template <unsigned int Bits>
+CBasicPath<Bits>::CBasicPath() : nodes() {}
+
+// Constructs a path from a set of nodes.
+template <unsigned int Bits>
+CBasicPath<Bits>::CBasicPath(const std::vector<uint16_t>& nodes) : nodes(nodes) {}
 
 // Retrieves the nodes of the path.
-const std::vector<uint16_t>& CPath::GetNodes() const
+template <unsigned int Bits>
+const std::vector<uint16_t>& CBasicPath<Bits>::GetNodes() const
 {
     // Return the nodes vector.
     return nodes;
 }
 
 // Computes the SHA3-256 hash of the path.
-std::vector<unsigned char> CPath::GetHash() const
+template <unsigned int Bits>
+std::vector<unsigned char> CBasicPath<Bits>::GetHash() const
 {
     CStream s;
 
@@ -40,7 +50,8 @@ std::vector<unsigned char> CPath::GetHash() const
 }
 
 // Validates the path against the graph.
-bool CPath::IsValid(const CGraph& graph) const
+template <unsigned int Bits>
+bool CBasicPath<Bits>::IsValid(const CBasicGraph<Bits>& graph) const
 {
 #ifdef DEBUG
     std::cout << __func__ << " - nodes.size(): " << nodes.size() << std::endl;
@@ -52,9 +63,6 @@ bool CPath::IsValid(const CGraph& graph) const
         return false;
     }
 
-    // Retrieve the adjacency matrix.
-    const auto& adjacencyMatrix = graph.GetAdjacencyMatrix();
-
     // Validate each edge in the path.
     for (std::size_t i = 0; i < nodes.size() - 1; ++i) {
         // Current node in the sequence.
@@ -67,12 +75,12 @@ bool CPath::IsValid(const CGraph& graph) const
 #endif
 
         // Check edge validity.
-        if (from >= MAX_NODES || to >= MAX_NODES || !adjacencyMatrix[from].test(to)) {
+        if (from >= MAX_NODES || to >= MAX_NODES || !graph.HasEdge(from, to)) {
 #ifdef DEBUG
             std::cout << __func__ << " - MAX_NODES: " << MAX_NODES << std::endl;
             std::cout << __func__ << " - from: " << from << std::endl;
             std::cout << __func__ << " - to: " << from << std::endl;
-            std::cout << __func__ << " - test: " << adjacencyMatrix[from].test(to) << std::endl;
+            std::cout << __func__ << " - test: " << graph.HasEdge(from, to) << std::endl;
 #endif
 
             return false;
@@ -83,21 +91,23 @@ bool CPath::IsValid(const CGraph& graph) const
     return true;
 }
 
-void CPath::Clear()
+template <unsigned int Bits>
+void CBasicPath<Bits>::Clear()
 {
     // Clear nodes
     nodes.clear();
 }
 
 // Validates if the given hash matches the hash of a path found in the provided graph.
-bool CPath::Validate(const std::vector<unsigned char>& hash, const CGraph& graph)
+template <unsigned int Bits>
+bool CBasicPath<Bits>::Validate(const std::vector<unsigned char>& hash, const CBasicGraph<Bits>& graph)
 {
 #ifdef DEBUG
     printf("hash (size=%zu): %s\n", hash.size(), FormatHex(hash).data());
 #endif
 
     // Find the path in the provided graph
-    std::vector<uint16_t> foundPath = FindDFS(graph);
+    std::vector<uint16_t> foundPath = FindPath(graph);
 
     // Get the hash of the found path
     std::vector<unsigned char> foundHash = GetHash();
@@ -111,7 +121,8 @@ bool CPath::Validate(const std::vector<unsigned char>& hash, const CGraph& graph
 }
 
 // Converts the path to a string.
-std::string CPath::ToString() const
+template <unsigned int Bits>
+std::string CBasicPath<Bits>::ToString() const
 {
     CStream s;
 
@@ -124,14 +135,16 @@ std::string CPath::ToString() const
 }
 
 // Returns the number of nodes in the path.
-std::size_t CPath::Size() const
+template <unsigned int Bits>
+std::size_t CBasicPath<Bits>::Size() const
 {
     // Return the count of nodes.
     return nodes.size();
 }
 
 // Saves the nodes to a file
-bool CPath::SaveNodesToFile(const std::string& filename) const
+template <unsigned int Bits>
+bool CBasicPath<Bits>::SaveNodesToFile(const std::string& filename) const
 {
     std::ofstream outFile(filename, std::ios::binary);
     if (!outFile) {
@@ -155,92 +168,181 @@ bool CPath::SaveNodesToFile(const std::string& filename) const
     return true;
 }
 
+// Scratch space of a DFS worker
+template <unsigned int Bits>
+struct alignas(64) CBasicPath<Bits>::CDFSScratch {
+    ///< Nodes of the current path, used as an explicit stack.
+    std::array<uint16_t, MAX_NODES> stack;
+
+    ///< Visited nodes of the current path (512 bytes), all clear between searches.
+    std::bitset<MAX_NODES> visited;
+};
+
+// Scratch space of the linear-time search, kept on the heap as it is too large for
+// the stack (or the TLS) of a pool or embedder thread with a 16-bit graph
+template <unsigned int Bits>
+struct alignas(64) CBasicPath<Bits>::CWalkScratch {
+    ///< Number of nodes on the path starting at each node (0 = not computed yet).
+    std::array<uint32_t, MAX_NODES> depth;
+
+    ///< Nodes visited by the current walk, waiting for their depth.
+    std::array<uint16_t, MAX_NODES> pending;
+};
+
+// Scratch space of the checkpoint search, only allocated by paths searching rebuilt graphs
+template <unsigned int Bits>
+struct alignas(64) CBasicPath<Bits>::CSinkScratch {
+    ///< Sink reached from each checkpoint node, valid where its depth is set.
+    std::array<uint16_t, MAX_NODES> sinkOf;
+
+    ///< Position of every sink already seen in sinkBests, valid where fSeen is set.
+    std::array<uint16_t, MAX_NODES> slot;
+
+    ///< Sinks already seen in sinkBests.
+    std::bitset<MAX_NODES> fSeen;
+};
+
+// Frees the scratch space of the path.
+template <unsigned int Bits>
+CBasicPath<Bits>::~CBasicPath() = default;
+
+// Allocates and zero-fills the scratch space of every search up front.
+template <unsigned int Bits>
+void CBasicPath<Bits>::ReserveScratch()
+{
+    // Value-initialized, so every page is written and faulted in now
+    if (!walkScratch) {
+        walkScratch = std::make_unique<CWalkScratch>();
+    }
+    if (!sinkScratch) {
+        sinkScratch = std::make_unique<CSinkScratch>();
+    }
+
+    // SetNumThreads() caps the DFS workers at the number of cores
+    std::size_t numWorkers = std::max(1u, std::thread::hardware_concurrency());
+    if (dfsScratch.size() < numWorkers) {
+        dfsScratch.resize(numWorkers);
+    }
+}
+
+// Gets the linear-time search scratch space of the path, allocating it on first use.
+template <unsigned int Bits>
+typename CBasicPath<Bits>::CWalkScratch& CBasicPath<Bits>::GetWalkScratch()
+{
+    if (!walkScratch) {
+        walkScratch = std::make_unique<CWalkScratch>();
+    }
+
+    return *walkScratch;
+}
+
+// Canonical ordering of longest path candidates
+template <unsigned int Bits>
+bool CBasicPath<Bits>::IsBetterPath(const CPathCandidate& candidate, const CPathCandidate& best)
+{
+    // A start node without a path to a leaf never wins
+    if (candidate.length == 0) {
+        return false;
+    }
+
+    // The longest path wins, then the lowest start node (that is, the
+    // lexicographically smallest node sequence)
+    return candidate.length > best.length || (candidate.length == best.length && candidate.start < best.start);
+}
+
 // Utility function for Depth-First Search (DFS) to find the longest path
-void CPath::DFSHelper(const CGraph& graph, std::size_t node, std::vector<bool>& visited, std::vector<uint16_t>& currentPath, std::vector<uint16_t>& longestPath, std::mutex& mtx)
+template <unsigned int Bits>
+std::size_t CBasicPath<Bits>::DFSHelper(const CBasicGraph<Bits>& graph, uint16_t start, CDFSScratch& scratch)
 {
-    // Mark the current node as visited and add it to the current path
-    visited[node] = true;
-    currentPath.push_back(node);
-
-    // Get the neighbors of the current node from the adjacency matrix
-    std::bitset<MAX_NODES> neighbors = graph.adjacencyMatrix[node];
-
-    // Explore unvisited neighbors efficiently using _Find_first and _Find_next
-    for (std::size_t neighbor = neighbors._Find_first();
-         neighbor < MAX_NODES;
-         neighbor = neighbors._Find_next(neighbor)) {
-        // If the neighbor hasn't been visited, recurse into DFS
-        if (!visited[neighbor]) {
-            DFSHelper(graph, neighbor, visited, currentPath, longestPath, mtx);
-        }
+    // Push the start node on the explicit stack
+    std::size_t top = 0;
+    scratch.stack[top++] = start;
+    scratch.visited.set(start);
+
+    // Walk down the path; every node has at most one neighbor, so there is
+    // never a sibling left to explore once a dead end is reached
+    uint16_t node = start;
+    while (graph.occupancy.test(node) && !scratch.visited.test(graph.successors[node])) {
+        node = graph.successors[node];
+        scratch.stack[top++] = node;
+        scratch.visited.set(node);
     }
 
-    // If we reached a leaf node (no further neighbors)
-    if (neighbors.none()) {
-        // Lock the mutex for thread safety
-        std::lock_guard<std::mutex> lock(mtx);
+    // Only a path ending at a leaf node (no further neighbors) counts
+    std::size_t length = graph.occupancy.test(node) ? 0 : top;
 
-        // Check if the current path is longer than the longest path found so far
-        if (currentPath.size() > longestPath.size()) {
-            longestPath = currentPath;
-        }
+    // Backtrack: clear only the visited bits set by this search
+    while (top > 0) {
+        scratch.visited.reset(scratch.stack[--top]);
     }
 
-    // Backtrack: remove the current node from the path and mark it as unvisited
-    currentPath.pop_back();
-    visited[node] = false;
+    return length;
 }
 
 // Finds the longest path in the graph represented by the adjacency matrix
-std::vector<uint16_t> CPath::FindDFS(const CGraph& graph)
+template <unsigned int Bits>
+std::vector<uint16_t> CBasicPath<Bits>::FindDFS(const CBasicGraph<Bits>& graph)
 {
     // Clear the current path to avoid dirty adjacencyMatrix
     Clear();
 
-    // Mutex for thread safety when updating longestPath
-    std::mutex mtx;
+    // The longest path always starts at a root: any other start node has a
+    // predecessor whose path is one node longer.
+    std::vector<uint16_t> starts = graph.GetRoots();
 
-    // Get the total number of nodes
-    unsigned int totalNodes = MAX_NODES;
+    // Index of the next start node to be claimed by a worker
+    std::atomic<std::size_t> nextStart{0};
 
-    // Create a vector of threads
-    std::vector<std::thread> threads;
+    // Best path found by each worker, reduced once all of them are done
+    std::vector<CPathCandidate> candidates(graph.nThreads);
 
-    // Vector to store the longest path found by all threads
-    std::vector<uint16_t> longestPath;
+    // One scratch space per worker, kept by the path for the next searches
+    if (dfsScratch.size() < graph.nThreads) {
+        dfsScratch.resize(graph.nThreads);
+    }
+
+    // Workers claim small chunks of start nodes until none is left, so the
+    // work is balanced however the long chains are scattered over the ids
+    CThreadPool::Get().Run(graph.nThreads, [&](unsigned int threadIndex) {
+        // Scratch space reused by every search of this worker
+        CDFSScratch& scratch = dfsScratch[threadIndex];
 
-    // Divide work among threads
-    for (unsigned int threadIndex = 0; threadIndex < graph.nThreads; ++threadIndex) {
-        threads.emplace_back([&, threadIndex]() {
-            // Vector to store the current path during the DFS traversal for this thread
-            std::vector<uint16_t> currentPath;
+        // Best path found by this worker, only written by this worker
+        CPathCandidate best;
 
-            // Calculate the number of nodes each thread will process
-            unsigned int nodesPerThread = totalNodes / graph.nThreads;
+        for (std::size_t first = nextStart.fetch_add(DFS_START_CHUNK); first < starts.size(); first = nextStart.fetch_add(DFS_START_CHUNK)) {
+            std::size_t last = std::min(first + DFS_START_CHUNK, starts.size());
 
-            // Determine start and end range for this thread
-            uint16_t startNode = threadIndex * nodesPerThread;
-            uint16_t endNode = (threadIndex + 1 == graph.nThreads) ? totalNodes : startNode + nodesPerThread;
+            // Iterate through the claimed nodes
+            for (std::size_t i = first; i < last; ++i) {
+                // Start DFS from the valid node
+                CPathCandidate candidate;
+                candidate.start = starts[i];
+                candidate.length = DFSHelper(graph, starts[i], scratch);
 
-            // Iterate through the assigned nodes
-            for (uint16_t start = startNode; start < endNode; ++start) {
-                // Skip nodes without edges
-                if (graph.adjacencyMatrix[start].none()) {
-                    continue;
+                if (IsBetterPath(candidate, best)) {
+                    best = candidate;
                 }
+            }
+        }
 
-                // Track visited nodes
-                std::vector<bool> visited(MAX_NODES, false);
+        candidates[threadIndex] = best;
+    });
 
-                // Start DFS from the valid node
-                DFSHelper(graph, start, visited, currentPath, longestPath, mtx);
-            }
-        });
+    // Reduce the workers' results with the same canonical ordering, so the
+    // winner does not depend on how the start nodes were shared out
+    CPathCandidate best;
+    for (const CPathCandidate& candidate : candidates) {
+        if (IsBetterPath(candidate, best)) {
+            best = candidate;
+        }
     }
 
-    // Wait for all threads to finish
-    for (auto& thread : threads) {
-        thread.join();
+    // Rebuild the winning path once by following the successors of its start node
+    std::vector<uint16_t> longestPath;
+    longestPath.reserve(best.length);
+    for (uint16_t node = best.start; longestPath.size() < best.length; node = graph.successors[node]) {
+        longestPath.push_back(node);
     }
 
 #ifdef DEBUG
@@ -256,4 +358,218 @@ std::vector<uint16_t> CPath::FindDFS(const CGraph& graph)
 
     // Return the longest path found
     return longestPath;
-}
\ No newline at end of file
+}
+
+// Computes the best path ending at every sink of the graph checkpoint.
+template <unsigned int Bits>
+void CBasicPath<Bits>::ComputeSinkBests(const CBasicGraph<Bits>& graph)
+{
+    sinkBests.clear();
+
+    // The checkpoint is built from data, which never closes a cycle
+    const std::bitset<MAX_NODES>& occupied = graph.checkpointOccupancy;
+
+    // Scratch space reused by every search of this path
+    CWalkScratch& scratch = GetWalkScratch();
+    if (!sinkScratch) {
+        sinkScratch = std::make_unique<CSinkScratch>();
+    }
+
+    // Number of nodes from each checkpoint node to its sink (0 = not computed yet), and that sink
+    std::array<uint32_t, MAX_NODES>& depth = scratch.depth;
+    std::array<uint16_t, MAX_NODES>& sinkOf = sinkScratch->sinkOf;
+    depth.fill(0);
+
+    // Nodes visited by the current walk, waiting for their depth
+    std::array<uint16_t, MAX_NODES>& pending = scratch.pending;
+
+    // Position of every sink already seen in sinkBests
+    std::bitset<MAX_NODES>& fSeen = sinkScratch->fSeen;
+    std::array<uint16_t, MAX_NODES>& slot = sinkScratch->slot;
+    fSeen.reset();
+
+    for (std::size_t start = graph.checkpointRoots._Find_first(); start < MAX_NODES; start = graph.checkpointRoots._Find_next(start)) {
+        // Walk forward until reaching the sink or a node whose depth is already known
+        std::size_t top = 0;
+        uint16_t node = start;
+        while (depth[node] == 0 && occupied.test(node)) {
+            pending[top++] = node;
+            node = graph.successors[node];
+        }
+
+        uint32_t length = depth[node] == 0 ? 1 : depth[node];
+        uint16_t sink = depth[node] == 0 ? node : sinkOf[node];
+
+        // Unwind the walk, assigning the depth and sink of every node on it
+        while (top > 0) {
+            node = pending[--top];
+            depth[node] = ++length;
+            sinkOf[node] = sink;
+        }
+
+        CPathCandidate candidate;
+        candidate.start = start;
+        candidate.length = depth[start];
+
+        // Keep the best candidate of every sink, with the canonical ordering
+        if (!fSeen.test(sink)) {
+            fSeen.set(sink);
+            slot[sink] = sinkBests.size();
+            sinkBests.push_back({sink, candidate});
+        } else if (IsBetterPath(candidate, sinkBests[slot[sink]].best)) {
+            sinkBests[slot[sink]].best = candidate;
+        }
+    }
+
+    nSinkBestsId = graph.nCheckpointId;
+}
+
+// Finds the longest path of a graph rebuilt from a checkpoint.
+template <unsigned int Bits>
+typename CBasicPath<Bits>::CPathCandidate CBasicPath<Bits>::FindBestFromCheckpoint(const CBasicGraph<Bits>& graph)
+{
+    if (nSinkBestsId != graph.nCheckpointId) {
+        ComputeSinkBests(graph);
+    }
+
+    CPathCandidate best;
+
+    // The roots of the checkpoint keep their path to the sink, which the new
+    // edges may extend; every root of a sink gets the same extension.
+    for (const CSinkBest& entry : sinkBests) {
+        CPathCandidate candidate = entry.best;
+        for (uint16_t node = entry.sink; graph.occupancy.test(node); node = graph.successors[node]) {
+            ++candidate.length;
+        }
+
+        if (IsBetterPath(candidate, best)) {
+            best = candidate;
+        }
+    }
+
+    // Roots created by the new edges, whose paths only run through new edges
+    for (uint16_t start : graph.undoLog) {
+        if (!graph.roots.test(start)) {
+            continue;
+        }
+
+        CPathCandidate candidate;
+        candidate.start = start;
+        candidate.length = 1;
+        for (uint16_t node = start; graph.occupancy.test(node); node = graph.successors[node]) {
+            ++candidate.length;
+        }
+
+        if (IsBetterPath(candidate, best)) {
+            best = candidate;
+        }
+    }
+
+    return best;
+}
+
+// Finds the longest path in the graph in linear time
+template <unsigned int Bits>
+std::vector<uint16_t> CBasicPath<Bits>::FindLongestPath(const CBasicGraph<Bits>& graph)
+{
+    // Marks a node whose depth is being computed by the current walk
+    constexpr uint32_t DEPTH_PENDING = 0xFFFFFFFE;
+
+    // Marks a node whose chain runs into a cycle and never reaches a leaf
+    constexpr uint32_t DEPTH_NONE = 0xFFFFFFFF;
+
+    // Clear the current path to avoid dirty nodes
+    Clear();
+
+    // Longest path found so far
+    CPathCandidate best;
+
+    if (graph.fCheckpoint) {
+        // Only the edges added since the checkpoint need to be walked
+        best = FindBestFromCheckpoint(graph);
+    } else {
+        // Scratch space reused by every search of this path
+        CWalkScratch& scratch = GetWalkScratch();
+
+        // Number of nodes on the path starting at each node (0 = not computed yet)
+        std::array<uint32_t, MAX_NODES>& depth = scratch.depth;
+        depth.fill(0);
+
+        // Nodes visited by the current walk, waiting for their depth
+        std::array<uint16_t, MAX_NODES>& pending = scratch.pending;
+
+        // Only roots can start the longest path
+        for (std::size_t start = graph.roots._Find_first(); start < MAX_NODES; start = graph.roots._Find_next(start)) {
+            // Walk forward until reaching a leaf or a node whose depth is already known
+            std::size_t top = 0;
+            uint16_t node = start;
+            while (depth[node] == 0 && graph.occupancy.test(node)) {
+                depth[node] = DEPTH_PENDING;
+                pending[top++] = node;
+                node = graph.successors[node];
+            }
+
+            // A leaf ends a path of one node, a pending node closes a cycle
+            uint32_t length;
+            if (depth[node] == 0) {
+                length = depth[node] = 1;
+            } else if (depth[node] == DEPTH_PENDING) {
+                length = DEPTH_NONE;
+            } else {
+                length = depth[node];
+            }
+
+            // Unwind the walk, assigning the depth of every node on it
+            while (top > 0) {
+                node = pending[--top];
+                if (length != DEPTH_NONE) {
+                    ++length;
+                }
+                depth[node] = length;
+            }
+
+            // Apply the same canonical ordering as FindDFS
+            CPathCandidate candidate;
+            candidate.start = start;
+            candidate.length = depth[start] != DEPTH_NONE ? depth[start] : 0;
+
+            if (IsBetterPath(candidate, best)) {
+                best = candidate;
+            }
+        }
+    }
+
+    // Rebuild the winning path by following the successors of its start node
+    nodes.reserve(best.length);
+    for (uint16_t node = best.start; nodes.size() < best.length; node = graph.successors[node]) {
+        nodes.push_back(node);
+    }
+
+#ifdef DEBUG
+    std::cout << "Longest Path: ";
+    for (std::size_t node : nodes) {
+        std::cout << node << " ";
+    }
+    std::cout << std::endl;
+#endif
+
+    // Return the longest path found
+    return nodes;
+}
+
+// Finds the longest path with the search selected for the graph
+template <unsigned int Bits>
+std::vector<uint16_t> CBasicPath<Bits>::FindPath(const CBasicGraph<Bits>& graph)
+{
+    // Parallel DFS was requested, otherwise the linear-time search is faster
+    if (graph.nThreads > 1) {
+        return FindDFS(graph);
+    }
+
+    return FindLongestPath(graph);
+}
+
+template class CBasicPath<10>;
+template class CBasicPath<12>;
+template class CBasicPath<14>;
+template class CBasicPath<16>;
@@ -5,35 +5,66 @@
 #ifndef QYRA_PATH_H
 #define QYRA_PATH_H
 
+#include <graph.h>
+
 #include <cstddef>
 #include <cstdint>
-#include <mutex>
+#include <memory>
 #include <string>
 #include <vector>
 
-class CGraph;
+/**
+ * @brief Number of DFS start nodes claimed at once by a worker in FindDFS.
+ */
+constexpr std::size_t DFS_START_CHUNK = 4;
 
 /**
  * @brief Represents a path in terms of a set of nodes.
+ *
+ * The longest path of a graph is a consensus value, so every search engine and
+ * every threading mode selects it with the same rule: the path with the most
+ * nodes wins, and among paths of the same length the lexicographically smallest
+ * node sequence wins. Since a node has at most one outgoing edge, two distinct
+ * paths of the same length differ in their start node, so this is the path
+ * with the lowest start node.
+ *
+ * @tparam Bits Number of bits of a node index, as in CBasicGraph.
  */
-class CPath
+template <unsigned int Bits>
+class CBasicPath
 {
 public:
+    ///< Maximum number of nodes allowed in the graph.
+    static constexpr std::size_t MAX_NODES = CBasicGraph<Bits>::MAX_NODES;
+
     /**
-     * @brief Default constructor for CPath.
+     * @brief Default constructor for CBasicPath.
      *
      * Initializes an empty path.
      */
-    CPath() : nodes() {}
+    CBasicPath();
+
+    /**
+     * @brief Destructor for CBasicPath, freeing the scratch space.
+     */
+    ~CBasicPath();
 
     void Clear();
 
+    /**
+     * @brief Allocates and zero-fills the scratch space of every search up front.
+     *
+     * The searches otherwise allocate it on first use. Enough DFS scratch is
+     * reserved for one worker per core.
+     */
+    void ReserveScratch();
+
     /**
      * @brief Constructor that initializes the path with a given vector.
      *
      * @param nodes A vector of nodes to initialize the path.
      */
-    CPath(const std::vector<uint16_t>& nodes);
+    CBasicPath(const std::vector<uint16_t>& nodes);
 
     /**
      * @brief Retrieves the nodes of the path.
@@ -56,20 +87,21 @@ public:
      *
      * @return True if the path is valid, false otherwise.
      */
-    bool IsValid(const CGraph& graph) const;
+    bool IsValid(const CBasicGraph<Bits>& graph) const;
 
     /**
      * @brief Validates if the provided hash matches the hash of the path found in the graph.
      *
-     * This function takes the input hash and a reference to the graph object. It uses the graph to find a path
-     * and then compares the hash of the found path with the provided hash. If they match, the solution is valid.
+     * This function takes the input hash and a reference to the graph object. It uses the graph to find the
+     * longest path with FindPath() and then compares the hash of the found path with the provided hash.
+     * If they match, the solution is valid.
      *
      * @param hash The vector containing the expected hash of the path.
-     * @param graph The reference to the CGraph object from which the path is generated.
+     * @param graph The reference to the graph object from which the path is generated.
      *
      * @return True if the hashes match, indicating that the path was correctly found and verified, false otherwise.
      */
-    bool Validate(const std::vector<unsigned char>& hash, const CGraph& graph);
+    bool Validate(const std::vector<unsigned char>& hash, const CBasicGraph<Bits>& graph);
 
     /**
      * @brief Converts the path to a string.
@@ -97,31 +129,163 @@ public:
     /**
      * @brief Finds the longest path in the graph represented by the adjacency matrix.
      *
-     * This function iterates through all nodes and performs DFS from each valid node.
+     * This function performs DFS from each root of the graph (see CBasicGraph::GetRoots()).
+     * The start nodes are handed out to the workers in chunks of DFS_START_CHUNK, and
+     * the result does not depend on the number of threads (see IsBetterPath()).
      *
-     * @param graph The reference to the CGraph object.
+     * @param graph The reference to the graph object.
      *
      * @return A vector containing the nodes in the longest path found.
      */
-    std::vector<uint16_t> FindDFS(const CGraph& graph);
+    std::vector<uint16_t> FindDFS(const CBasicGraph<Bits>& graph);
+
+    /**
+     * @brief Finds the longest path in the graph in linear time.
+     *
+     * Every node has at most one outgoing edge, so the number of nodes on the path
+     * starting at a node is memoized and shared by every chain flowing into it.
+     * The result is identical to FindDFS() with any number of threads: the longest
+     * path wins and ties are broken in favour of the lowest start node.
+     *
+     * When the graph was rebuilt from a checkpoint (see CBasicGraph::UpdateGraphFromData()),
+     * the best path ending at each sink of the checkpoint is computed once per
+     * checkpoint, and only the edges added since the checkpoint are walked.
+     *
+     * @param graph The reference to the graph object.
+     *
+     * @return A vector containing the nodes in the longest path found.
+     */
+    std::vector<uint16_t> FindLongestPath(const CBasicGraph<Bits>& graph);
+
+    /**
+     * @brief Finds the longest path with the search selected for the graph.
+     *
+     * FindDFS() runs when the graph was given more than one thread (see
+     * CBasicGraph::SetNumThreads()), FindLongestPath() otherwise. Both select
+     * the same path.
+     *
+     * @param graph The reference to the graph object.
+     *
+     * @return A vector containing the nodes in the longest path found.
+     */
+    std::vector<uint16_t> FindPath(const CBasicGraph<Bits>& graph);
 
 private:
     ///< A vector containing the nodes of the path.
     std::vector<uint16_t> nodes;
 
+    ///< Scratch space of a DFS worker (explicit stack and visited bitmap).
+    struct CDFSScratch;
+
+    ///< Scratch space of the linear-time search (node depths and the current walk).
+    struct CWalkScratch;
+
+    ///< Scratch space of every FindDFS() worker, indexed by thread and grown on demand.
+    std::vector<CDFSScratch> dfsScratch;
+
+    ///< Scratch space of the checkpoint search (sink of every node and sink positions).
+    struct CSinkScratch;
+
+    ///< Scratch space of FindLongestPath(), allocated on first use.
+    std::unique_ptr<CWalkScratch> walkScratch;
+
+    ///< Scratch space of ComputeSinkBests(), allocated on the first checkpoint search.
+    std::unique_ptr<CSinkScratch> sinkScratch;
+
+    /**
+     * @brief Gets the linear-time search scratch space of the path, allocating it on first use.
+     *
+     * @return A reference to the scratch space, reused by every search of this path.
+     */
+    CWalkScratch& GetWalkScratch();
+
+    /**
+     * @brief Best path found by a DFS worker, identified by its start node.
+     */
+    struct CPathCandidate {
+        ///< First node of the path.
+        uint16_t start = 0;
+
+        ///< Number of nodes in the path (0 if no path was found).
+        std::size_t length = 0;
+    };
+
+    /**
+     * @brief Best path of a graph checkpoint ending at one of its sinks.
+     */
+    struct CSinkBest {
+        ///< Node without an outgoing edge at the checkpoint, where the paths end.
+        uint16_t sink = 0;
+
+        ///< Best path of the checkpoint ending at the sink, the sink included.
+        CPathCandidate best;
+    };
+
+    ///< Best checkpoint path for every sink of the checkpoint nSinkBestsId.
+    std::vector<CSinkBest> sinkBests;
+
+    ///< Identifier of the checkpoint sinkBests was computed for, 0 if none.
+    uint64_t nSinkBestsId = 0;
+
+    /**
+     * @brief Computes the best path ending at every sink of the graph checkpoint.
+     *
+     * Edges added after the checkpoint only start at nodes without an outgoing
+     * edge at the checkpoint and never end at a node that had one, so a path
+     * from a checkpoint root runs through the checkpoint to one of its sinks and
+     * then only through the new edges.
+     *
+     * @param graph The reference to the graph object.
+     */
+    void ComputeSinkBests(const CBasicGraph<Bits>& graph);
+
+    /**
+     * @brief Finds the longest path of a graph rebuilt from a checkpoint.
+     *
+     * @param graph The reference to the graph object.
+     *
+     * @return The start node and number of nodes of the longest path.
+     */
+    CPathCandidate FindBestFromCheckpoint(const CBasicGraph<Bits>& graph);
+
+    /**
+     * @brief Canonical ordering of longest path candidates.
+     *
+     * @param candidate The candidate being considered.
+     * @param best The best candidate so far.
+     *
+     * @return True if candidate has more nodes than best, or as many nodes and a lower start node.
+     */
+    static bool IsBetterPath(const CPathCandidate& candidate, const CPathCandidate& best);
+
     /**
      * @brief Utility function for Depth-First Search (DFS) to find the longest path.
      *
-     * This function explores all possible paths from the current node recursively.
+     * This function explores the paths from the start node iteratively, using the
+     * preallocated stack and visited bitmap of the scratch space. Only the visited
+     * bits set by the search are cleared before returning.
      *
-     * @param graph The reference to the CGraph object.
-     * @param node The current node being explored.
-     * @param visited A vector that keeps track of visited nodes for the current thread's processing range.
-     * @param currentPath A vector that stores the current path being explored.
-     * @param longestPath A reference to the longest path found so far, which may be updated during the search.
-     * @param mtx A mutex to protect access to shared data (longestPath) among multiple threads.
+     * @param graph The reference to the graph object.
+     * @param start The node the search starts from.
+     * @param scratch The scratch space of the calling worker.
+     *
+     * @return The number of nodes in the path from the start node to a leaf, or 0 if there is none.
      */
-    void DFSHelper(const CGraph& graph, std::size_t node, std::vector<bool>& visited, std::vector<uint16_t>& currentPath, std::vector<uint16_t>& longestPath, std::mutex& mtx);
+    std::size_t DFSHelper(const CBasicGraph<Bits>& graph, uint16_t start, CDFSScratch& scratch);
+};
+
+extern template class CBasicPath<10>;
+extern template class CBasicPath<12>;
+extern template class CBasicPath<14>;
+extern template class CBasicPath<16>;
+
+/**
+ * @brief A path in the consensus graph (CGraph).
+ */
+class CPath : public CBasicPath<NODE_BITS>
+{
+public:
+    using CBasicPath<NODE_BITS>::CBasicPath;
 };
 
 #endif // QYRA_PATH_H
\ No newline at end of file
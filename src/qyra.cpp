@@ -5,27 +5,43 @@
 #include <qyra.h>
 
 #include <graph.h>
+#include <kempool.h>
 #include <path.h>
 #include <stream.h>
+#include <threadpool.h>
 #include <utils.h>
+#include <validation.h>
+#include <workspace.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <stdio.h>
 #include <thread>
+#include <utility>
 #include <vector>
 
 namespace LibQYRA {
 // Constructs a CQYRA object and initializes internal components.
-CQYRA::CQYRA() : graph(nullptr), path(nullptr)
+CQYRA::CQYRA() : workspace(nullptr), graph(nullptr), path(nullptr), fConcurrentValidation(false)
 {
-    graph = new CGraph();
-    path = new CPath();
+    // Take a preallocated graph and path from the shared pool
+    workspace = CWorkspacePool::Get().Acquire();
+    graph = &workspace->graph;
+    path = &workspace->path;
+
+    // Keep the shared worker pool alive while this instance exists
+    CThreadPool::Get().Attach();
 }
 
 // Destroys the CQYRA object, freeing allocated resources.
 CQYRA::~CQYRA()
 {
-    delete graph;
-    delete path;
+    // Give the graph and path back to the shared pool
+    CWorkspacePool::Get().Release(workspace);
+
+    // The last instance shuts the shared worker pool down
+    CThreadPool::Get().Detach();
 }
 
 // Assembles cryptographic data into a single vector.
@@ -82,12 +98,58 @@ void CQYRA::EnableParallelDFS()
     graph->SetNumThreads(numCores);
 }
 
+// Sets the number of worker threads of the shared pool.
+void CQYRA::SetWorkerThreads(unsigned int numThreads)
+{
+    CThreadPool::Get().SetSize(numThreads);
+}
+
+// Preallocates the graph and path workspaces shared by all instances.
+void CQYRA::ReserveWorkspaces(std::size_t count, bool fHugePages)
+{
+    CWorkspacePool::Get().Reserve(count, fHugePages);
+}
+
+// Starts background threads that precompute Kyber-768 encapsulations.
+bool CQYRA::StartKEMPool(const uint8_t* public_key, std::size_t depth, unsigned int numProducers)
+{
+    return CKEMPool::Get().Start(public_key, depth, numProducers);
+}
+
+// Stops the background encapsulation pool.
+void CQYRA::StopKEMPool()
+{
+    CKEMPool::Get().Stop();
+}
+
+// Reports the state of the background encapsulation pool.
+CKEMPoolStats CQYRA::GetKEMPoolStats()
+{
+    CKEMPool::CStats stats = CKEMPool::Get().GetStats();
+
+    CKEMPoolStats result;
+    result.depth = stats.nDepth;
+    result.producers = stats.nProducers;
+    result.available = stats.nAvailable;
+    result.produced = stats.nProduced;
+    result.taken = stats.nTaken;
+    result.misses = stats.nMisses;
+
+    return result;
+}
+
 // Sets the header data.
 void CQYRA::SetHeader(const std::vector<unsigned char>& vch)
 {
     graph->SetHeader(vch);
 }
 
+// Sets how many nonces share one key encapsulation while mining.
+void CQYRA::SetEncapsulationReuse(unsigned int numNonces, bool fShareIV)
+{
+    graph->SetEncapsulationReuse(numNonces, fShareIV);
+}
+
 // Sets the nonce data.
 void CQYRA::SetNonce(const std::vector<unsigned char>& vch)
 {
@@ -116,6 +178,10 @@ bool CQYRA::Validate(const std::vector<unsigned char>& vch) const
     s >> graphData;
     s >> pathHash;
 
+    if (fConcurrentValidation) {
+        return ValidateConcurrently(graphData, pathHash);
+    }
+
     // Validate the graph.
     if (!graph->Validate(graphData)) {
         fprintf(stderr, "ERROR: [%s] Graph validation failed.\n", __func__);
@@ -136,6 +202,241 @@ bool CQYRA::Validate(const std::vector<unsigned char>& vch) const
     return true;
 }
 
+// Charges the cost of a stage to a work budget, if there is one.
+static void ChargeBudget(CValidationBudget* budget, uint64_t nCost)
+{
+    if (!budget) {
+        return;
+    }
+
+    budget->spent += nCost;
+    budget->remaining = nCost < budget->remaining ? budget->remaining - nCost : 0;
+}
+
+// Gets the nanoseconds elapsed since a point in time.
+static uint64_t GetElapsed(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Runs the validation stages of a solution on a graph and path, cheapest first.
+static ValidationResult RunValidationStages(CGraph& graph, CPath& path, const std::vector<unsigned char>& vch, CValidationBudget* budget)
+{
+    CValidationCosts& costs = CValidationCosts::Get();
+
+    // Structural checks, too cheap to be worth timing or charging to the budget.
+    bool fWellFormed = vch.size() >= SOLUTION_SIZE;
+    costs.Record(ValidationStage::STRUCTURE, 0, !fWellFormed);
+
+    if (!fWellFormed) {
+        return ValidationResult::INVALID_SIZE;
+    }
+
+    // Unpack the solution into its components: graph and path hash.
+    std::vector<unsigned char> graphData;
+    std::vector<unsigned char> pathHash;
+
+    graphData.resize(TOTAL_SIZE);
+    pathHash.resize(HASH_SIZE);
+
+    CStream s(vch);
+    s >> graphData;
+    s >> pathHash;
+
+    // The encryption and path checks do not depend on each other, run the cheaper one first
+    ValidationStage stages[2] = {ValidationStage::PATH, ValidationStage::ENCRYPTION};
+    if (costs.GetEstimate(ValidationStage::ENCRYPTION) < costs.GetEstimate(ValidationStage::PATH)) {
+        std::swap(stages[0], stages[1]);
+    }
+
+    for (ValidationStage stage : stages) {
+        // Do not start a stage the peer can no longer pay for
+        if (budget && (budget->remaining == 0 || costs.GetEstimate(stage) > budget->remaining)) {
+            return ValidationResult::BUDGET_EXHAUSTED;
+        }
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        bool fPassed;
+        if (stage == ValidationStage::ENCRYPTION) {
+            fPassed = graph.CheckEncryption(graphData);
+        } else {
+            fPassed = graph.LoadSolution(graphData) && path.Validate(pathHash, graph);
+        }
+
+        uint64_t nCost = GetElapsed(start);
+
+        costs.Record(stage, nCost, !fPassed);
+        ChargeBudget(budget, nCost);
+
+        if (!fPassed) {
+            return stage == ValidationStage::ENCRYPTION ? ValidationResult::INVALID_ENCRYPTION : ValidationResult::INVALID_PATH;
+        }
+    }
+
+    // Return VALID on success
+    return ValidationResult::VALID;
+}
+
+// Validates a solution in stages, cheapest first, within an optional work budget.
+ValidationResult CQYRA::ValidateStaged(const std::vector<unsigned char>& vch, CValidationBudget* budget) const
+{
+    return RunValidationStages(*graph, *path, vch, budget);
+}
+
+// Validates a batch of solutions in parallel on the shared worker pool.
+bool CQYRA::ValidateBatch(std::span<const CValidationItem> items, std::span<ValidationResult> results) const
+{
+    // Every item needs a slot for its verdict
+    if (items.size() != results.size()) {
+        fprintf(stderr, "ERROR: [%s] Invalid batch: %zu items but %zu results.\n", __func__, items.size(), results.size());
+
+        // Return false on failure
+        return false;
+    }
+
+    if (items.empty()) {
+        return true;
+    }
+
+    // One task per worker plus the calling thread, but no more than there are items
+    std::size_t numTasks = std::min<std::size_t>(items.size(), CThreadPool::Get().GetSize() + 1);
+
+    // Take the workspaces before starting, tasks must not throw
+    std::vector<CWorkspace*> workspaces;
+    workspaces.reserve(numTasks);
+
+    // Released workspaces are wiped, so the keys copied below do not outlive the batch
+    bool fInitialized = true;
+    try {
+        while (fInitialized && workspaces.size() < numTasks) {
+            workspaces.push_back(CWorkspacePool::Get().Acquire());
+            fInitialized = workspaces.back()->graph.Initialize(*graph);
+        }
+    } catch (...) {
+        for (CWorkspace* ws : workspaces) {
+            CWorkspacePool::Get().Release(ws);
+        }
+        throw;
+    }
+
+    if (!fInitialized) {
+        for (CWorkspace* ws : workspaces) {
+            CWorkspacePool::Get().Release(ws);
+        }
+
+        fprintf(stderr, "ERROR: [%s] Failed to initialize the batch workspaces.\n", __func__);
+
+        // Return false on failure
+        return false;
+    }
+
+    // Tasks take items one at a time, so a slow solution does not hold up a whole share of the batch
+    std::atomic<std::size_t> nNext{0};
+
+    CThreadPool::Get().Run(numTasks, [&](unsigned int task) {
+        CWorkspace* ws = workspaces[task];
+
+        for (std::size_t i = nNext.fetch_add(1); i < items.size(); i = nNext.fetch_add(1)) {
+            ws->graph.SetHeader(items[i].header);
+            ws->graph.SetNonce(items[i].nonce);
+
+            results[i] = RunValidationStages(ws->graph, ws->path, items[i].solution, nullptr);
+        }
+    });
+
+    for (CWorkspace* ws : workspaces) {
+        CWorkspacePool::Get().Release(ws);
+    }
+
+    // Return true on success
+    return true;
+}
+
+// Converts the counters of a stage to the public structure.
+static CValidationStageStats GetStageStats(ValidationStage stage)
+{
+    CValidationCosts::CStats stats = CValidationCosts::Get().GetStats(stage);
+
+    CValidationStageStats result;
+    result.runs = stats.nRuns;
+    result.rejects = stats.nRejects;
+    result.averageCost = stats.nAverageCost;
+
+    return result;
+}
+
+// Reports the measured cost of every validation stage, across all instances.
+CValidationStats CQYRA::GetValidationStats()
+{
+    CValidationStats result;
+    result.structure = GetStageStats(ValidationStage::STRUCTURE);
+    result.encryption = GetStageStats(ValidationStage::ENCRYPTION);
+    result.path = GetStageStats(ValidationStage::PATH);
+
+    return result;
+}
+
+// Enables validating the encryption and the path of a solution at the same time.
+void CQYRA::SetConcurrentValidation(bool fEnable)
+{
+    fConcurrentValidation = fEnable;
+}
+
+// Runs the encryption check and the graph and path check at the same time.
+bool CQYRA::ValidateConcurrently(const std::vector<unsigned char>& graphData, const std::vector<unsigned char>& pathHash) const
+{
+    // Set by the first check that fails, so the other one stops at its next step
+    std::atomic<bool> fCancel{false};
+
+    // Each flag is only written by its own check and read once both are done
+    bool fEncryptionValid = true;
+    bool fGraphValid = true;
+    bool fPathValid = true;
+
+    CThreadPool::Get().Run(2, [&](unsigned int check) {
+        if (check == 0) {
+            // Kyber-768 decapsulation and AES decryption of the header and nonce
+            if (!graph->CheckEncryption(graphData, &fCancel) && !fCancel.exchange(true)) {
+                fEncryptionValid = false;
+            }
+            return;
+        }
+
+        // Graph build, longest path search and path hash, from the encrypted data alone
+        if (!graph->LoadSolution(graphData)) {
+            fGraphValid = false;
+            fCancel.store(true);
+            return;
+        }
+
+        if (fCancel.load()) {
+            return;
+        }
+
+        if (!path->Validate(pathHash, *graph) && !fCancel.exchange(true)) {
+            fPathValid = false;
+        }
+    });
+
+    if (!fEncryptionValid || !fGraphValid) {
+        fprintf(stderr, "ERROR: [%s] Graph validation failed.\n", __func__);
+
+        // Return false on failure
+        return false;
+    }
+
+    if (!fPathValid) {
+        fprintf(stderr, "ERROR: [%s] Path validation failed.\n", __func__);
+
+        // Return false on failure
+        return false;
+    }
+
+    // Return true on success
+    return true;
+}
+
 // Starts the mining process to find a solution to the graph.
 bool CQYRA::Mine()
 {
@@ -157,8 +458,8 @@ bool CQYRA::Mine()
         return false;
     }
 
-    // Finds the longest path in the graph using Depth-First Search (DFS).
-    std::vector<uint16_t> foundPath = path->FindDFS(*graph);
+    // Finds the longest path in the graph.
+    std::vector<uint16_t> foundPath = path->FindPath(*graph);
 
     // Check if a valid path was found.
     // If the path size is zero, it indicates no valid path was found.
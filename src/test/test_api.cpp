@@ -6,6 +6,7 @@
 
 #include <qyra.h>
 #include <utils.h>
+#include <validation.h>
 
 // IWYU pragma: no_include <boost/preprocessor/comparison/limits/not_equal_256.hpp>
 // IWYU pragma: no_include <boost/preprocessor/control/iif.hpp>
@@ -81,4 +82,239 @@ BOOST_AUTO_TEST_CASE(ValidateSolution)
 #endif
 }
 
+BOOST_AUTO_TEST_CASE(ConcurrentValidation)
+{
+    // Mine a solution for the sample header and nonce
+    LibQYRA::CQYRA miner;
+
+    BOOST_CHECK(miner.Initialize(publicKey, secretKey) == true);
+
+    miner.SetHeader(header);
+    miner.SetNonce(nonce);
+
+    BOOST_REQUIRE(miner.Mine() == true);
+
+    std::vector<unsigned char> solution = miner.solution.Get();
+    BOOST_REQUIRE(solution.size() == SOLUTION_SIZE);
+
+    // Validate it with both checks running at the same time
+    LibQYRA::CQYRA qyra;
+
+    BOOST_CHECK(qyra.Initialize(publicKey, secretKey) == true);
+
+    qyra.SetHeader(header);
+    qyra.SetNonce(nonce);
+    qyra.SetConcurrentValidation(true);
+
+    BOOST_CHECK(qyra.Validate(solution) == true);
+
+    // A damaged ciphertext only fails the encryption check
+    std::vector<unsigned char> badCiphertext(solution);
+    badCiphertext[ENC_SIZE + IV_SIZE] ^= 0x01;
+    BOOST_CHECK(qyra.Validate(badCiphertext) == false);
+
+    // A damaged path hash only fails the path check
+    std::vector<unsigned char> badHash(solution);
+    badHash[TOTAL_SIZE] ^= 0x01;
+    BOOST_CHECK(qyra.Validate(badHash) == false);
+
+    // Damaged encrypted data fails both
+    std::vector<unsigned char> badEnc(solution);
+    badEnc[0] ^= 0x01;
+    BOOST_CHECK(qyra.Validate(badEnc) == false);
+
+    // The instance still validates once the other checks were cancelled
+    BOOST_CHECK(qyra.Validate(solution) == true);
+
+    // Both modes agree
+    qyra.SetConcurrentValidation(false);
+    BOOST_CHECK(qyra.Validate(solution) == true);
+    BOOST_CHECK(qyra.Validate(badCiphertext) == false);
+    BOOST_CHECK(qyra.Validate(badHash) == false);
+}
+
+BOOST_AUTO_TEST_CASE(StagedValidation)
+{
+    // Mine a solution for the sample header and nonce
+    LibQYRA::CQYRA miner;
+
+    BOOST_CHECK(miner.Initialize(publicKey, secretKey) == true);
+
+    miner.SetHeader(header);
+    miner.SetNonce(nonce);
+
+    BOOST_REQUIRE(miner.Mine() == true);
+
+    std::vector<unsigned char> solution = miner.solution.Get();
+
+    LibQYRA::CQYRA qyra;
+
+    BOOST_CHECK(qyra.Initialize(publicKey, secretKey) == true);
+
+    qyra.SetHeader(header);
+    qyra.SetNonce(nonce);
+
+    LibQYRA::CValidationStats before = LibQYRA::CQYRA::GetValidationStats();
+
+    BOOST_CHECK(qyra.ValidateStaged(solution) == LibQYRA::ValidationResult::VALID);
+
+    // Each damaged part is caught by its own stage
+    std::vector<unsigned char> shortSolution(solution.begin(), solution.end() - 1);
+    BOOST_CHECK(qyra.ValidateStaged(shortSolution) == LibQYRA::ValidationResult::INVALID_SIZE);
+
+    std::vector<unsigned char> badCiphertext(solution);
+    badCiphertext[ENC_SIZE + IV_SIZE] ^= 0x01;
+    BOOST_CHECK(qyra.ValidateStaged(badCiphertext) == LibQYRA::ValidationResult::INVALID_ENCRYPTION);
+
+    std::vector<unsigned char> badHash(solution);
+    badHash[TOTAL_SIZE] ^= 0x01;
+    BOOST_CHECK(qyra.ValidateStaged(badHash) == LibQYRA::ValidationResult::INVALID_PATH);
+
+    // Every stage was measured
+    LibQYRA::CValidationStats after = LibQYRA::CQYRA::GetValidationStats();
+
+    BOOST_CHECK(after.structure.runs == before.structure.runs + 4);
+    BOOST_CHECK(after.structure.rejects == before.structure.rejects + 1);
+    BOOST_CHECK(after.encryption.rejects >= before.encryption.rejects + 1);
+    BOOST_CHECK(after.path.rejects >= before.path.rejects + 1);
+    BOOST_CHECK(after.encryption.averageCost > 0);
+    BOOST_CHECK(after.path.averageCost > 0);
+
+    // A budget large enough for everything is charged for the work done
+    LibQYRA::CValidationBudget budget;
+    budget.remaining = 60ull * 1000 * 1000 * 1000;
+
+    BOOST_CHECK(qyra.ValidateStaged(solution, &budget) == LibQYRA::ValidationResult::VALID);
+    BOOST_CHECK(budget.spent > 0);
+    BOOST_CHECK(budget.remaining + budget.spent == 60ull * 1000 * 1000 * 1000);
+
+    // An exhausted budget stops before the expensive stages
+    budget.remaining = 0;
+
+    BOOST_CHECK(qyra.ValidateStaged(solution, &budget) == LibQYRA::ValidationResult::BUDGET_EXHAUSTED);
+    BOOST_CHECK(qyra.ValidateStaged(badHash, &budget) == LibQYRA::ValidationResult::BUDGET_EXHAUSTED);
+    BOOST_CHECK(qyra.ValidateStaged(shortSolution, &budget) == LibQYRA::ValidationResult::INVALID_SIZE);
+
+    // Validate() reaches the same verdicts, without touching the shared measurements
+    before = LibQYRA::CQYRA::GetValidationStats();
+
+    BOOST_CHECK(qyra.Validate(solution) == true);
+    BOOST_CHECK(qyra.Validate(badCiphertext) == false);
+    BOOST_CHECK(qyra.Validate(badHash) == false);
+
+    after = LibQYRA::CQYRA::GetValidationStats();
+
+    BOOST_CHECK(after.structure.runs == before.structure.runs);
+    BOOST_CHECK(after.encryption.runs == before.encryption.runs);
+    BOOST_CHECK(after.path.runs == before.path.runs);
+}
+
+BOOST_AUTO_TEST_CASE(StagedValidationColdStart)
+{
+    LibQYRA::CQYRA miner;
+
+    BOOST_CHECK(miner.Initialize(publicKey, secretKey) == true);
+
+    miner.SetHeader(header);
+    miner.SetNonce(nonce);
+
+    BOOST_REQUIRE(miner.Mine() == true);
+
+    std::vector<unsigned char> solution = miner.solution.Get();
+
+    LibQYRA::CQYRA qyra;
+
+    BOOST_CHECK(qyra.Initialize(publicKey, secretKey) == true);
+
+    qyra.SetHeader(header);
+    qyra.SetNonce(nonce);
+
+    // Nothing measured yet, as on a freshly started node
+    CValidationCosts::Get().Reset();
+
+    BOOST_CHECK(CValidationCosts::Get().GetEstimate(ValidationStage::ENCRYPTION) > 0);
+    BOOST_CHECK(CValidationCosts::Get().GetEstimate(ValidationStage::PATH) > 0);
+
+    // An empty budget or one below the default costs stops before the expensive stages
+    LibQYRA::CValidationBudget budget;
+
+    BOOST_CHECK(qyra.ValidateStaged(solution, &budget) == LibQYRA::ValidationResult::BUDGET_EXHAUSTED);
+
+    budget.remaining = 1;
+    BOOST_CHECK(qyra.ValidateStaged(solution, &budget) == LibQYRA::ValidationResult::BUDGET_EXHAUSTED);
+
+    LibQYRA::CValidationStats stats = LibQYRA::CQYRA::GetValidationStats();
+    BOOST_CHECK_EQUAL(stats.encryption.runs, 0);
+    BOOST_CHECK_EQUAL(stats.path.runs, 0);
+
+    // Without a budget the solution is fully validated
+    BOOST_CHECK(qyra.ValidateStaged(solution) == LibQYRA::ValidationResult::VALID);
+}
+
+BOOST_AUTO_TEST_CASE(BatchValidation)
+{
+    LibQYRA::CQYRA miner;
+
+    BOOST_CHECK(miner.Initialize(publicKey, secretKey) == true);
+
+    miner.SetHeader(header);
+
+    // Mine solutions for a few nonces and damage some copies of them
+    std::vector<LibQYRA::CValidationItem> items;
+    std::vector<LibQYRA::ValidationResult> expected;
+
+    for (unsigned char i = 0; i < 4; ++i) {
+        std::vector<unsigned char> itemNonce(nonce);
+        itemNonce.back() ^= i;
+
+        miner.SetNonce(itemNonce);
+        BOOST_REQUIRE(miner.Mine() == true);
+
+        LibQYRA::CValidationItem item{header, itemNonce, miner.solution.Get()};
+
+        items.push_back(item);
+        expected.push_back(LibQYRA::ValidationResult::VALID);
+
+        LibQYRA::CValidationItem badCiphertext(item);
+        badCiphertext.solution[ENC_SIZE + IV_SIZE] ^= 0x01;
+        items.push_back(badCiphertext);
+        expected.push_back(LibQYRA::ValidationResult::INVALID_ENCRYPTION);
+
+        LibQYRA::CValidationItem badHash(item);
+        badHash.solution[TOTAL_SIZE] ^= 0x01;
+        items.push_back(badHash);
+        expected.push_back(LibQYRA::ValidationResult::INVALID_PATH);
+
+        LibQYRA::CValidationItem shortSolution(item);
+        shortSolution.solution.pop_back();
+        items.push_back(shortSolution);
+        expected.push_back(LibQYRA::ValidationResult::INVALID_SIZE);
+    }
+
+    // The header and nonce of the validating instance are not used
+    LibQYRA::CQYRA qyra;
+
+    BOOST_CHECK(qyra.Initialize(publicKey, secretKey) == true);
+
+    std::vector<LibQYRA::ValidationResult> results(items.size(), LibQYRA::ValidationResult::BUDGET_EXHAUSTED);
+
+    BOOST_CHECK(qyra.ValidateBatch(items, results) == true);
+    BOOST_CHECK(results == expected);
+
+    // The verdicts match validating the items one at a time
+    for (std::size_t i = 0; i < items.size(); ++i) {
+        qyra.SetHeader(items[i].header);
+        qyra.SetNonce(items[i].nonce);
+
+        BOOST_CHECK(qyra.ValidateStaged(items[i].solution) == results[i]);
+    }
+
+    // The result span must match the items
+    results.pop_back();
+    BOOST_CHECK(qyra.ValidateBatch(items, results) == false);
+
+    // An empty batch is valid
+    BOOST_CHECK(qyra.ValidateBatch({}, {}) == true);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
\ No newline at end of file
@@ -30,6 +30,10 @@
 #include <boost/test/unit_test.hpp> // IWYU pragma: keep
 #include <openssl/evp.h>
 #include <oqs/oqs.h> // IWYU pragma: keep
+#include <set>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
 #include <vector>
 
 // Define a test suite for testing the CCrypter class.
@@ -110,5 +114,142 @@ BOOST_AUTO_TEST_CASE(EncryptDecrypt)
                                   decryptedData.begin(), decryptedData.end());
 }
 
+// Test case for reusing the cipher contexts of a thread across messages and keys.
+BOOST_AUTO_TEST_CASE(ContextReuse)
+{
+    uint8_t key1[OQS_KEM_kyber_768_length_shared_secret];
+    uint8_t key2[OQS_KEM_kyber_768_length_shared_secret];
+    for (size_t i = 0; i < sizeof(key1); ++i) {
+        key1[i] = static_cast<uint8_t>(i);
+        key2[i] = static_cast<uint8_t>(0xFF - i);
+    }
+
+    std::vector<unsigned char> message(100, 0x5A);
+    std::vector<unsigned char> enc1, enc2, dec, iv1, iv2;
+
+    // Encrypt two messages in a row with different keys on the same thread.
+    BOOST_CHECK(CCrypter::EncryptData(message, enc1, key1, iv1));
+    BOOST_CHECK(CCrypter::EncryptData(message, enc2, key2, iv2));
+    BOOST_CHECK(enc1 != enc2);
+
+    // A truncated message fails to decrypt and must not spoil the next one.
+    std::vector<unsigned char> truncated(enc1.begin(), enc1.end() - 1);
+    BOOST_CHECK(!CCrypter::DecryptData(truncated, dec, key1, iv1));
+
+    BOOST_CHECK(CCrypter::DecryptData(enc2, dec, key2, iv2));
+    BOOST_CHECK(dec == message);
+    BOOST_CHECK(CCrypter::DecryptData(enc1, dec, key1, iv1));
+    BOOST_CHECK(dec == message);
+
+    // Another thread uses its own contexts and gets the same result.
+    bool ret = false;
+    std::vector<unsigned char> decOther;
+    std::thread([&] { ret = CCrypter::DecryptData(enc1, decOther, key1, iv1); }).join();
+    BOOST_CHECK(ret);
+    BOOST_CHECK(decOther == message);
+}
+
+// Test case for the per-thread IV generator and caller-supplied IVs.
+BOOST_AUTO_TEST_CASE(IVSource)
+{
+    // Enough IVs to cross several refills of the keystream buffer.
+    std::set<std::vector<unsigned char>> ivs;
+    std::vector<unsigned char> iv;
+    for (int i = 0; i < 1000; ++i) {
+        BOOST_CHECK(CCrypter::GenerateIV(iv));
+        BOOST_CHECK_EQUAL(iv.size(), EVP_MAX_IV_LENGTH);
+        ivs.insert(iv);
+    }
+    BOOST_CHECK_EQUAL(ivs.size(), 1000U);
+
+    uint8_t key[OQS_KEM_kyber_768_length_shared_secret] = {0x42};
+    std::vector<unsigned char> message(100, 0x5A);
+    std::vector<unsigned char> fixedIV(EVP_MAX_IV_LENGTH, 0x01);
+    std::vector<unsigned char> enc1, enc2, dec;
+
+    // The same IV and key always give the same encrypted message.
+    BOOST_CHECK(CCrypter::EncryptDataWithIV(message, enc1, key, fixedIV));
+    BOOST_CHECK(CCrypter::EncryptDataWithIV(message, enc2, key, fixedIV));
+    BOOST_CHECK(enc1 == enc2);
+    BOOST_CHECK(CCrypter::DecryptData(enc1, dec, key, fixedIV));
+    BOOST_CHECK(dec == message);
+
+    // An IV of the wrong size is rejected.
+    std::vector<unsigned char> shortIV(8, 0x01);
+    BOOST_CHECK(!CCrypter::EncryptDataWithIV(message, enc1, key, shortIV));
+}
+
+// Test case for the IV generator of a forked process.
+BOOST_AUTO_TEST_CASE(IVSourceFork)
+{
+    // Seed the generator of this thread before forking.
+    std::vector<unsigned char> iv;
+    BOOST_CHECK(CCrypter::GenerateIV(iv));
+
+    int fds[2];
+    BOOST_REQUIRE(pipe(fds) == 0);
+
+    pid_t pid = fork();
+    BOOST_REQUIRE(pid >= 0);
+
+    // The child sends the next IV it generates to the parent.
+    std::vector<unsigned char> next;
+    bool ret = CCrypter::GenerateIV(next);
+    if (pid == 0) {
+        ssize_t nWritten = ret ? write(fds[1], next.data(), next.size()) : 0;
+        _exit(nWritten == static_cast<ssize_t>(EVP_MAX_IV_LENGTH) ? 0 : 1);
+    }
+
+    std::vector<unsigned char> childIV(EVP_MAX_IV_LENGTH);
+    BOOST_CHECK(read(fds[0], childIV.data(), childIV.size()) == static_cast<ssize_t>(childIV.size()));
+    close(fds[0]);
+    close(fds[1]);
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    BOOST_CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    // Parent and child must not hand out the same IVs.
+    BOOST_CHECK(ret);
+    BOOST_CHECK(next != childIV);
+}
+
+// Test case for encrypting from a cached CBC midstate of a message prefix.
+BOOST_AUTO_TEST_CASE(Midstate)
+{
+    uint8_t key[OQS_KEM_kyber_768_length_shared_secret] = {0x42};
+    std::vector<unsigned char> fixedIV(EVP_MAX_IV_LENGTH, 0x01);
+
+    // Prefixes shorter than, equal to and past a block boundary, as the 108-byte header.
+    for (std::size_t nPrefix : {0, 5, 16, 32, 108}) {
+        std::vector<unsigned char> prefix(nPrefix);
+        for (std::size_t i = 0; i < nPrefix; ++i) {
+            prefix[i] = static_cast<unsigned char>(i * 7);
+        }
+
+        CCBCMidstate midstate;
+        BOOST_CHECK(midstate.Initialize(prefix, key, fixedIV));
+        BOOST_CHECK(midstate.Matches(prefix, fixedIV));
+
+        for (std::size_t nSuffix : {1, 20, 32}) {
+            std::vector<unsigned char> suffix(nSuffix, static_cast<unsigned char>(nSuffix));
+            std::vector<unsigned char> message(prefix);
+            message.insert(message.end(), suffix.begin(), suffix.end());
+
+            // The midstate gives the same encrypted message as a full encryption.
+            std::vector<unsigned char> expected, enc;
+            BOOST_CHECK(CCrypter::EncryptDataWithIV(message, expected, key, fixedIV));
+            BOOST_CHECK(midstate.Encrypt(suffix, enc));
+            BOOST_CHECK(enc == expected);
+        }
+
+        // A cleared midstate matches nothing and refuses to encrypt.
+        std::vector<unsigned char> enc;
+        midstate.Clear();
+        BOOST_CHECK(!midstate.Matches(prefix, fixedIV));
+        BOOST_CHECK(!midstate.Encrypt(prefix, enc));
+    }
+}
+
 // End of test suite for CCrypter class.
 BOOST_AUTO_TEST_SUITE_END()
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include <test.h>
 
 #include <graph.h>
+#include <hash.h>
 #include <path.h>
 #include <qyra.h>
 #include <stream.h>
@@ -29,8 +30,14 @@
 // IWYU pragma: no_include <boost/test/utils/basic_cstring/basic_cstring.hpp>
 // IWYU pragma: no_include <boost/test/utils/lazy_ostream.hpp>
 
+#include <algorithm>
 #include <boost/test/unit_test.hpp> // IWYU pragma: keep
+#include <bitset>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <memory>
 #include <stdint.h>
 #include <string>
 #include <thread>
@@ -205,5 +212,396 @@ BOOST_AUTO_TEST_CASE(Validate)
     BOOST_CHECK_EQUAL(FormatHex(path.GetHash()), expectedPathHash);
 }
 
+// Test case for the successor array and its adjacency matrix view.
+BOOST_AUTO_TEST_CASE(AdjacencyMatrixView)
+{
+    // Create a graph object.
+    CGraph graph;
+
+    // Add a few edges, including one that must be ignored.
+    BOOST_CHECK(graph.AddEdge(1, 2) == true);
+    BOOST_CHECK(graph.AddEdge(2, 4095) == true);
+    BOOST_CHECK(graph.AddEdge(1, 3) == true);
+
+    // Out of bounds nodes are rejected.
+    BOOST_CHECK(graph.AddEdge(MAX_NODES, 1) == false);
+
+    // Only the first edge leaving a node is kept.
+    uint16_t successor = 0;
+    BOOST_CHECK(graph.GetSuccessor(1, successor) == true);
+    BOOST_CHECK_EQUAL(successor, 2);
+    BOOST_CHECK(graph.HasEdge(1, 3) == false);
+    BOOST_CHECK(graph.HasEdge(2, 4095) == true);
+    BOOST_CHECK(graph.GetSuccessor(4095, successor) == false);
+
+    // The materialized matrix must agree with the successor array.
+    const auto& adjacencyMatrix = graph.GetAdjacencyMatrix();
+    BOOST_CHECK_EQUAL(adjacencyMatrix.size(), MAX_NODES);
+    BOOST_CHECK(adjacencyMatrix[1].test(2) == true);
+    BOOST_CHECK(adjacencyMatrix[2].test(4095) == true);
+    BOOST_CHECK_EQUAL(adjacencyMatrix[1].count() + adjacencyMatrix[2].count(), 2);
+
+    // Clearing the graph must not affect a matrix retrieved before.
+    graph.Clear();
+    BOOST_CHECK(graph.GetAdjacencyMatrix()[1].none() == true);
+    BOOST_CHECK(graph.GetAdjacencyMatrix()[2].none() == true);
+    BOOST_CHECK(adjacencyMatrix[1].test(2) == true);
+    BOOST_CHECK(graph.HasEdge(1, 2) == false);
+
+    // A node that had an incoming edge before clearing is a root again.
+    BOOST_CHECK(graph.AddEdge(4095, 9) == true);
+    BOOST_CHECK(graph.GetRoots() == std::vector<uint16_t>({4095}));
+    BOOST_CHECK(graph.GetAdjacencyMatrix()[4095].test(9) == true);
+}
+
+// Test case for generating a graph with a caller-supplied IV.
+BOOST_AUTO_TEST_CASE(FixedIV)
+{
+    CGraph graph;
+    BOOST_CHECK(graph.Initialize(publicKey, secretKey) == true);
+    graph.SetHeader(header);
+    graph.SetNonce(nonce);
+
+    // The supplied IV is used for every generation.
+    std::vector<unsigned char> fixedIV(16, 0xA5);
+    graph.SetIV(fixedIV);
+    BOOST_CHECK(graph.Generate() == true);
+    BOOST_CHECK(graph.GetIV() == fixedIV);
+
+    // An empty IV goes back to random IVs.
+    graph.SetIV({});
+    BOOST_CHECK(graph.Generate() == true);
+    BOOST_CHECK(graph.GetIV() != fixedIV);
+}
+
+// Test case for sharing one key encapsulation across nonces.
+BOOST_AUTO_TEST_CASE(EncapsulationReuse)
+{
+    CGraph graph;
+    BOOST_CHECK(graph.Initialize(publicKey, secretKey) == true);
+    graph.SetHeader(header);
+
+    // Two nonces per encapsulation.
+    graph.SetEncapsulationReuse(2);
+
+    std::vector<std::vector<unsigned char>> ciphertexts, ivs;
+    for (unsigned char i = 0; i < 3; ++i) {
+        std::vector<unsigned char> n(nonce);
+        n[0] ^= i;
+        graph.SetNonce(n);
+        BOOST_CHECK(graph.Generate() == true);
+        ciphertexts.push_back(graph.GetCiphertext());
+        ivs.push_back(graph.GetIV());
+
+        // A graph built from a reused encapsulation validates like any other.
+        CGraph validator;
+        BOOST_CHECK(validator.Initialize(publicKey, secretKey) == true);
+        validator.SetHeader(header);
+        validator.SetNonce(n);
+
+        CStream s;
+        s << graph.GetEncMessage();
+        s << graph.GetIV();
+        s << graph.GetCiphertext();
+        BOOST_CHECK(validator.Validate(s.Data()) == true);
+        BOOST_CHECK(validator.GetHash(GRAPH_DIGEST_V2) == graph.GetHash(GRAPH_DIGEST_V2));
+    }
+    BOOST_CHECK(ciphertexts[0] == ciphertexts[1]);
+    BOOST_CHECK(ciphertexts[1] != ciphertexts[2]);
+    BOOST_CHECK(ivs[0] != ivs[1]);
+
+    // Once per header: a new header starts a new encapsulation.
+    graph.SetEncapsulationReuse(0);
+    BOOST_CHECK(graph.Generate() == true);
+    std::vector<unsigned char> first = graph.GetCiphertext();
+    BOOST_CHECK(first != ciphertexts[2]);
+    for (int i = 0; i < 4; ++i) {
+        BOOST_CHECK(graph.Generate() == true);
+        BOOST_CHECK(graph.GetCiphertext() == first);
+    }
+
+    std::vector<unsigned char> otherHeader(header);
+    otherHeader[0] ^= 0xFF;
+    graph.SetHeader(otherHeader);
+    BOOST_CHECK(graph.Generate() == true);
+    BOOST_CHECK(graph.GetCiphertext() != first);
+
+    // Sharing the IV encrypts the header once, every nonce still validates.
+    graph.SetHeader(header);
+    graph.SetEncapsulationReuse(3, true);
+    for (unsigned char i = 0; i < 4; ++i) {
+        std::vector<unsigned char> n(nonce);
+        n[31] ^= i;
+        graph.SetNonce(n);
+        BOOST_CHECK(graph.Generate() == true);
+        ivs.push_back(graph.GetIV());
+
+        CGraph validator;
+        BOOST_CHECK(validator.Initialize(publicKey, secretKey) == true);
+        validator.SetHeader(header);
+        validator.SetNonce(n);
+
+        CStream s;
+        s << graph.GetEncMessage();
+        s << graph.GetIV();
+        s << graph.GetCiphertext();
+        BOOST_CHECK(validator.Validate(s.Data()) == true);
+    }
+    BOOST_CHECK(ivs[3] == ivs[4]);
+    BOOST_CHECK(ivs[4] == ivs[5]);
+    BOOST_CHECK(ivs[5] != ivs[6]);
+}
+
+// Test case for rebuilding the graph and longest path from the checkpoint of the header blocks.
+BOOST_AUTO_TEST_CASE(IncrementalBuild)
+{
+    CGraph graph;
+    CPath path;
+    BOOST_CHECK(graph.Initialize(publicKey, secretKey) == true);
+    graph.SetHeader(header);
+
+    // One key and IV for every nonce, so the header blocks are shared.
+    graph.SetEncapsulationReuse(0, true);
+
+    for (unsigned int i = 0; i < 64; ++i) {
+        std::vector<unsigned char> n(nonce);
+        n[28] = static_cast<unsigned char>(i);
+        n[29] = static_cast<unsigned char>(i * 37);
+        graph.SetNonce(n);
+        BOOST_CHECK(graph.Generate() == true);
+
+        // A graph built from scratch from the same solution data.
+        CGraph full;
+        BOOST_CHECK(full.Initialize(publicKey, secretKey) == true);
+        full.SetHeader(header);
+        full.SetNonce(n);
+
+        CStream s;
+        s << graph.GetEncMessage();
+        s << graph.GetIV();
+        s << graph.GetCiphertext();
+        BOOST_CHECK(full.Validate(s.Data()) == true);
+
+        // Same edges, roots and longest path.
+        BOOST_CHECK(graph.GetHash(GRAPH_DIGEST_V2) == full.GetHash(GRAPH_DIGEST_V2));
+        BOOST_CHECK(graph.GetRoots() == full.GetRoots());
+
+        CPath fullPath;
+        BOOST_CHECK(path.FindLongestPath(graph) == fullPath.FindLongestPath(full));
+        BOOST_CHECK(path.FindLongestPath(graph) == fullPath.FindDFS(full));
+    }
+
+    // An edge added by hand in front of the longest path drops the checkpoint,
+    // the path is then searched in full and grows by one node.
+    std::vector<uint16_t> longest = path.FindLongestPath(graph);
+    BOOST_REQUIRE(!longest.empty());
+
+    uint16_t node = 0, successor;
+    while (graph.GetSuccessor(node, successor) || std::find(longest.begin(), longest.end(), node) != longest.end()) {
+        ++node;
+    }
+    BOOST_CHECK(graph.AddEdge(node, longest[0]) == true);
+
+    CPath dfsPath;
+    BOOST_CHECK(path.FindLongestPath(graph) == dfsPath.FindDFS(graph));
+    BOOST_CHECK(path.Size() > longest.size());
+}
+
+// Test case for the streamed serializations of the adjacency matrix.
+BOOST_AUTO_TEST_CASE(Serialization)
+{
+    // Create a graph object.
+    CGraph graph;
+
+    // Populate the first and last rows and a few in between.
+    BOOST_CHECK(graph.AddEdge(0, 4095) == true);
+    BOOST_CHECK(graph.AddEdge(9, 0) == true);
+    BOOST_CHECK(graph.AddEdge(10, 7) == true);
+    BOOST_CHECK(graph.AddEdge(4095, 8) == true);
+
+    // Serialize the materialized matrix the way it was done before streaming.
+    std::vector<unsigned char> expected;
+    for (const auto& row : graph.GetAdjacencyMatrix()) {
+        for (std::size_t i = 0; i < MAX_NODES / 8; ++i) {
+            unsigned char byte = 0;
+            for (std::size_t bit = 0; bit < 8; ++bit) {
+                byte |= row.test(i * 8 + bit) << bit;
+            }
+            expected.push_back(byte);
+        }
+    }
+
+    BOOST_CHECK(graph.GetHash() == CHasher::BLAKE3(expected));
+    BOOST_CHECK(graph.ToString() == FormatHex(expected));
+
+    // Hashing the data in pieces gives the same digest.
+    CHashWriter writer;
+    writer.Write(expected.data(), 1000);
+    writer.Write(expected.data() + 1000, expected.size() - 1000);
+    BOOST_CHECK(writer.Finalize() == CHasher::BLAKE3(expected));
+
+    // The saved file holds the same bytes.
+    std::string filename = (std::filesystem::temp_directory_path() / "qyra_test_graph.bin").string();
+    BOOST_CHECK(graph.SaveAdjacencyMatrixToFile(filename) == true);
+
+    std::ifstream inFile(filename, std::ios::binary);
+    std::vector<unsigned char> saved((std::istreambuf_iterator<char>(inFile)), std::istreambuf_iterator<char>());
+    inFile.close();
+    std::filesystem::remove(filename);
+
+    BOOST_CHECK(saved == expected);
+}
+
+// Test case for the edge list digest.
+BOOST_AUTO_TEST_CASE(DigestV2)
+{
+    // Create two graph objects with the same edges added in a different order.
+    CGraph graph1;
+    CGraph graph2;
+
+    BOOST_CHECK(graph1.AddEdge(3, 4) == true);
+    BOOST_CHECK(graph1.AddEdge(4095, 3) == true);
+    BOOST_CHECK(graph2.AddEdge(4095, 3) == true);
+    BOOST_CHECK(graph2.AddEdge(3, 4) == true);
+
+    // The default digest is still the full matrix one.
+    BOOST_CHECK(graph1.GetHash() == graph1.GetHash(GRAPH_DIGEST_V1));
+    BOOST_CHECK(graph1.GetHash(GRAPH_DIGEST_V1) != graph1.GetHash(GRAPH_DIGEST_V2));
+
+    // The edge list is canonical.
+    BOOST_CHECK(graph1.GetHash(GRAPH_DIGEST_V2) == graph2.GetHash(GRAPH_DIGEST_V2));
+
+    // It hashes the version and the width of a node index, then the sorted edges.
+    CStream s;
+    s << uint16_t(2) << uint16_t(12);
+    s << uint16_t(3) << uint16_t(4);
+    s << uint16_t(4095) << uint16_t(3);
+    BOOST_CHECK(graph1.GetHash(GRAPH_DIGEST_V2) == CHasher::BLAKE3(s.Data()));
+
+    // Any change of the edges changes the digest.
+    BOOST_CHECK(graph2.AddEdge(7, 3) == true);
+    BOOST_CHECK(graph1.GetHash(GRAPH_DIGEST_V2) != graph2.GetHash(GRAPH_DIGEST_V2));
+
+    // Unknown versions are rejected.
+    BOOST_CHECK(graph1.GetHash(3).empty() == true);
+}
+
+// Test case for the linear-time longest path engine.
+BOOST_AUTO_TEST_CASE(LongestPath)
+{
+    // Create a graph object.
+    CGraph graph;
+
+    // Create two path objects, one per engine.
+    CPath pathDFS;
+    CPath pathLinear;
+
+    // Two chains of the same length: the lowest start node must win.
+    graph.AddEdge(40, 41);
+    graph.AddEdge(41, 42);
+    graph.AddEdge(7, 8);
+    graph.AddEdge(8, 9);
+
+    // A shorter chain joining the first one.
+    graph.AddEdge(100, 42);
+
+    // A cycle, which never reaches a leaf and yields no path.
+    graph.AddEdge(200, 201);
+    graph.AddEdge(201, 202);
+    graph.AddEdge(202, 200);
+
+    // Only the heads of the chains are roots, the cycle has none.
+    BOOST_CHECK(graph.GetRoots() == std::vector<uint16_t>({7, 40, 100}));
+
+    BOOST_CHECK(pathLinear.FindLongestPath(graph) == std::vector<uint16_t>({7, 8, 9}));
+    BOOST_CHECK(pathLinear.FindLongestPath(graph) == pathDFS.FindDFS(graph));
+
+    // Both engines must agree on generated graphs as well.
+    BOOST_CHECK(graph.Initialize(publicKey, secretKey) == true);
+    graph.SetHeader(header);
+
+    for (unsigned char i = 0; i < 16; ++i) {
+        std::vector<unsigned char> vch(nonce);
+        vch[0] = i;
+        graph.SetNonce(vch);
+
+        BOOST_CHECK(graph.Generate() == true);
+        BOOST_CHECK(pathLinear.FindLongestPath(graph) == pathDFS.FindDFS(graph));
+        BOOST_CHECK(pathLinear.GetHash() == pathDFS.GetHash());
+    }
+}
+
+// Test case for the canonical choice among longest paths of the same length.
+BOOST_AUTO_TEST_CASE(LongestPathTieBreak)
+{
+    // Create a graph object.
+    CGraph graph;
+
+    // Create two path objects, one per engine.
+    CPath pathDFS;
+    CPath pathLinear;
+
+    // Many chains of the same length spread over the node ids, so they are
+    // shared out among different workers, plus shorter chains in between.
+    for (uint16_t start = 4000; start >= 100; start -= 100) {
+        uint16_t length = start % 200 == 0 ? 5 : 3;
+        for (uint16_t i = 0; i + 1 < length; ++i) {
+            graph.AddEdge(start + i, start + i + 1);
+        }
+    }
+
+    std::vector<uint16_t> expected = {200, 201, 202, 203, 204};
+    BOOST_CHECK(pathLinear.FindLongestPath(graph) == expected);
+
+    // The same path must be found whatever the number of threads.
+    unsigned int numCores = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned int numThreads = 1; numThreads <= numCores; ++numThreads) {
+        graph.SetNumThreads(numThreads);
+        BOOST_CHECK(pathDFS.FindDFS(graph) == expected);
+
+        // Parallel DFS is used when more than one thread is requested, with the same result.
+        BOOST_CHECK(pathDFS.FindPath(graph) == expected);
+    }
+}
+
+// Test case for graphs with other node index widths.
+BOOST_AUTO_TEST_CASE(NodeBits)
+{
+    // The consensus graph keeps 12-bit node indices.
+    BOOST_CHECK_EQUAL(CGraph::MAX_NODES, MAX_NODES);
+    BOOST_CHECK_EQUAL(CBasicGraph<10>::MAX_NODES, 1024);
+    BOOST_CHECK_EQUAL(CBasicGraph<16>::MAX_NODES, 65536);
+
+    // Every node index of a 16-bit graph is usable.
+    auto graph16 = std::make_unique<CBasicGraph<16>>();
+    CBasicPath<16> path16;
+    BOOST_CHECK(graph16->AddEdge(65535, 0) == true);
+    BOOST_CHECK(graph16->AddEdge(0, 40000) == true);
+    BOOST_CHECK(path16.FindLongestPath(*graph16) == std::vector<uint16_t>({65535, 0, 40000}));
+    BOOST_CHECK(path16.IsValid(*graph16) == true);
+
+    // Node indices beyond a 10-bit graph are rejected.
+    CBasicGraph<10> graph10;
+    BOOST_CHECK(graph10.AddEdge(1024, 0) == false);
+
+    // Graphs generated from the same data agree on both engines at every width.
+    CBasicPath<10> pathDFS10, pathLinear10;
+    BOOST_CHECK(graph10.Initialize(publicKey, secretKey) == true);
+    graph10.SetHeader(header);
+    graph10.SetNonce(nonce);
+    BOOST_CHECK(graph10.Generate() == true);
+    BOOST_CHECK(pathLinear10.FindLongestPath(graph10) == pathDFS10.FindDFS(graph10));
+    BOOST_CHECK(pathLinear10.IsValid(graph10) == true);
+
+    CBasicGraph<14> graph14;
+    CBasicPath<14> pathDFS14, pathLinear14;
+    BOOST_CHECK(graph14.Initialize(publicKey, secretKey) == true);
+    graph14.SetHeader(header);
+    graph14.SetNonce(nonce);
+    BOOST_CHECK(graph14.Generate() == true);
+    BOOST_CHECK(pathLinear14.FindLongestPath(graph14) == pathDFS14.FindDFS(graph14));
+    BOOST_CHECK(pathLinear14.IsValid(graph14) == true);
+}
+
 // End of test suite for CGraph class.
 BOOST_AUTO_TEST_SUITE_END()
\ No newline at end of file
@@ -0,0 +1,166 @@
+// Copyright (c) 2024 Marco Fortina
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#include <test.h>
+
+#include <crypto.h>
+#include <graph.h>
+#include <kempool.h>
+
+// IWYU pragma: no_include <boost/preprocessor/arithmetic/limits/dec_256.hpp>
+// IWYU pragma: no_include <boost/preprocessor/comparison/limits/not_equal_256.hpp>
+// IWYU pragma: no_include <boost/preprocessor/control/expr_iif.hpp>
+// IWYU pragma: no_include <boost/preprocessor/control/iif.hpp>
+// IWYU pragma: no_include <boost/preprocessor/detail/limits/auto_rec_256.hpp>
+// IWYU pragma: no_include <boost/preprocessor/logical/compl.hpp>
+// IWYU pragma: no_include <boost/preprocessor/logical/limits/bool_256.hpp>
+// IWYU pragma: no_include <boost/preprocessor/repetition/detail/limits/for_256.hpp>
+// IWYU pragma: no_include <boost/preprocessor/repetition/for.hpp>
+// IWYU pragma: no_include <boost/preprocessor/seq/limits/elem_256.hpp>
+// IWYU pragma: no_include <boost/preprocessor/seq/limits/size_256.hpp>
+// IWYU pragma: no_include <boost/preprocessor/tuple/elem.hpp>
+// IWYU pragma: no_include <boost/preprocessor/variadic/limits/elem_64.hpp>
+// IWYU pragma: no_include <boost/test/tools/old/interface.hpp>
+// IWYU pragma: no_include <boost/test/tree/auto_registration.hpp>
+// IWYU pragma: no_include <boost/test/unit_test_suite.hpp>
+// IWYU pragma: no_include <boost/test/utils/basic_cstring/basic_cstring.hpp>
+// IWYU pragma: no_include <boost/test/utils/lazy_ostream.hpp>
+
+#include <boost/test/unit_test.hpp> // IWYU pragma: keep
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <set>
+#include <thread>
+#include <vector>
+
+// Define a test suite for testing the CKEMPool class.
+BOOST_FIXTURE_TEST_SUITE(TestCKEMPool, BasicTestingSetup)
+
+// Test case for producing, taking and stopping encapsulations.
+BOOST_AUTO_TEST_CASE(ProduceTake)
+{
+    CKEMPool& pool = CKEMPool::Get();
+
+    // Encapsulate against a real key pair, so the shared secrets can be recovered.
+    BOOST_REQUIRE(CCrypter::GenerateKeyPair(public_key, secret_key) == true);
+
+    // Invalid parameters are rejected.
+    BOOST_CHECK(pool.Start(nullptr, 4, 1) == false);
+    BOOST_CHECK(pool.Start(public_key, 0, 1) == false);
+    BOOST_CHECK(pool.Start(public_key, 4, 0) == false);
+
+    // A ring has two cells at least, and stops cleanly once filled.
+    BOOST_CHECK(pool.Start(public_key, 1, 2) == true);
+    BOOST_CHECK_EQUAL(pool.GetStats().nDepth, 2);
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    pool.Stop();
+
+    // The depth is rounded up to a power of two.
+    BOOST_CHECK(pool.Start(public_key, 3, 2) == true);
+    BOOST_CHECK_EQUAL(pool.GetStats().nDepth, 4);
+    BOOST_CHECK_EQUAL(pool.GetStats().nProducers, 2);
+
+    // Wait for the producers to fill the ring.
+    for (int i = 0; i < 1000 && pool.GetStats().nAvailable < 4; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    BOOST_CHECK_EQUAL(pool.GetStats().nAvailable, 4);
+
+    // Every encapsulation is distinct and decapsulates to its shared secret.
+    std::set<std::vector<uint8_t>> ciphertexts;
+    for (int i = 0; i < 8; ++i) {
+        uint8_t ciphertext[OQS_KEM_kyber_768_length_ciphertext];
+        uint8_t sharedSecret[OQS_KEM_kyber_768_length_shared_secret];
+        uint8_t recovered[OQS_KEM_kyber_768_length_shared_secret];
+
+        // Producers refill the ring as encapsulations are taken.
+        bool fTaken = false;
+        for (int j = 0; j < 1000 && !fTaken; ++j) {
+            fTaken = pool.Take(ciphertext, sharedSecret, public_key);
+            if (!fTaken) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+        BOOST_REQUIRE(fTaken);
+
+        BOOST_CHECK(CCrypter::RecoverSharedSecret(recovered, ciphertext, secret_key) == true);
+        BOOST_CHECK(std::equal(recovered, recovered + sizeof(recovered), sharedSecret));
+        ciphertexts.emplace(ciphertext, ciphertext + sizeof(ciphertext));
+    }
+    BOOST_CHECK_EQUAL(ciphertexts.size(), 8);
+    BOOST_CHECK_EQUAL(pool.GetStats().nTaken, 8);
+    BOOST_CHECK(pool.GetStats().nProduced >= 8);
+
+    // Encapsulations are only handed out for the public key of the pool.
+    uint8_t otherKey[OQS_KEM_kyber_768_length_public_key];
+    std::copy(public_key, public_key + sizeof(otherKey), otherKey);
+    otherKey[0] ^= 0xFF;
+    BOOST_CHECK(pool.Take(cipher_text, shared_secret_e, otherKey) == false);
+
+    // Generate() takes its encapsulation from the pool.
+    CGraph graph;
+    BOOST_CHECK(graph.Initialize(public_key, secret_key) == true);
+    graph.SetHeader(originalData);
+    graph.SetNonce(originalData);
+
+    uint64_t nTaken = pool.GetStats().nTaken;
+    for (int i = 0; i < 1000 && pool.GetStats().nAvailable == 0; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    BOOST_CHECK(graph.Generate() == true);
+    BOOST_CHECK_EQUAL(pool.GetStats().nTaken, nTaken + 1);
+
+    // A stopped pool hands out nothing.
+    pool.Stop();
+    BOOST_CHECK(pool.Take(cipher_text, shared_secret_e, public_key) == false);
+    BOOST_CHECK_EQUAL(pool.GetStats().nDepth, 0);
+    BOOST_CHECK_EQUAL(pool.GetStats().nProducers, 0);
+}
+
+// Test case for restarting the pool while another thread takes encapsulations.
+BOOST_AUTO_TEST_CASE(RestartWhileTaking)
+{
+    CKEMPool& pool = CKEMPool::Get();
+
+    // Encapsulate against a real key pair, so the shared secrets can be recovered.
+    BOOST_REQUIRE(CCrypter::GenerateKeyPair(public_key, secret_key) == true);
+
+    std::atomic<bool> fDone{false};
+    std::atomic<int> nMismatches{0};
+
+    // Take encapsulations the whole time the pool is being restarted.
+    std::thread taker([&]() {
+        while (!fDone.load()) {
+            uint8_t ciphertext[OQS_KEM_kyber_768_length_ciphertext];
+            uint8_t sharedSecret[OQS_KEM_kyber_768_length_shared_secret];
+            uint8_t recovered[OQS_KEM_kyber_768_length_shared_secret];
+
+            if (!pool.Take(ciphertext, sharedSecret, public_key)) {
+                continue;
+            }
+
+            if (!CCrypter::RecoverSharedSecret(recovered, ciphertext, secret_key) ||
+                !std::equal(recovered, recovered + sizeof(recovered), sharedSecret)) {
+                nMismatches.fetch_add(1);
+            }
+        }
+    });
+
+    for (int i = 0; i < 20; ++i) {
+        BOOST_CHECK(pool.Start(public_key, 2, 1) == true);
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        pool.Stop();
+    }
+
+    fDone.store(true);
+    taker.join();
+
+    // Every encapsulation taken was intact.
+    BOOST_CHECK_EQUAL(nMismatches.load(), 0);
+    BOOST_CHECK_EQUAL(pool.GetStats().nDepth, 0);
+}
+
+// End of test suite for CKEMPool class.
+BOOST_AUTO_TEST_SUITE_END()
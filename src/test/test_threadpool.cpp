@@ -0,0 +1,177 @@
+// Copyright (c) 2024 Marco Fortina
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#include <test.h>
+
+#include <threadpool.h>
+
+// IWYU pragma: no_include <boost/preprocessor/arithmetic/limits/dec_256.hpp>
+// IWYU pragma: no_include <boost/preprocessor/comparison/limits/not_equal_256.hpp>
+// IWYU pragma: no_include <boost/preprocessor/control/expr_iif.hpp>
+// IWYU pragma: no_include <boost/preprocessor/control/iif.hpp>
+// IWYU pragma: no_include <boost/preprocessor/detail/limits/auto_rec_256.hpp>
+// IWYU pragma: no_include <boost/preprocessor/logical/compl.hpp>
+// IWYU pragma: no_include <boost/preprocessor/logical/limits/bool_256.hpp>
+// IWYU pragma: no_include <boost/preprocessor/repetition/detail/limits/for_256.hpp>
+// IWYU pragma: no_include <boost/preprocessor/repetition/for.hpp>
+// IWYU pragma: no_include <boost/preprocessor/seq/limits/elem_256.hpp>
+// IWYU pragma: no_include <boost/preprocessor/seq/limits/size_256.hpp>
+// IWYU pragma: no_include <boost/preprocessor/tuple/elem.hpp>
+// IWYU pragma: no_include <boost/preprocessor/variadic/limits/elem_64.hpp>
+// IWYU pragma: no_include <boost/test/tools/old/interface.hpp>
+// IWYU pragma: no_include <boost/test/tree/auto_registration.hpp>
+// IWYU pragma: no_include <boost/test/unit_test_suite.hpp>
+// IWYU pragma: no_include <boost/test/utils/basic_cstring/basic_cstring.hpp>
+// IWYU pragma: no_include <boost/test/utils/lazy_ostream.hpp>
+
+#include <atomic>
+#include <boost/test/unit_test.hpp> // IWYU pragma: keep
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+// Define a test suite for testing the CThreadPool class.
+BOOST_FIXTURE_TEST_SUITE(TestCThreadPool, BasicTestingSetup)
+
+// Test case for running a batch of tasks.
+BOOST_AUTO_TEST_CASE(Run)
+{
+    CThreadPool& pool = CThreadPool::Get();
+
+    // Every index must run exactly once.
+    std::vector<std::atomic<unsigned int>> counters(64);
+    pool.Run(counters.size(), [&](unsigned int i) { counters[i]++; });
+
+    for (const auto& counter : counters) {
+        BOOST_CHECK_EQUAL(counter.load(), 1u);
+    }
+
+    // A task may submit work to the same pool without deadlocking.
+    std::atomic<unsigned int> total{0};
+    pool.Run(8, [&](unsigned int) {
+        pool.Run(8, [&](unsigned int) { total++; });
+    });
+    BOOST_CHECK_EQUAL(total.load(), 64u);
+}
+
+// Test case for resizing and restarting the pool.
+BOOST_AUTO_TEST_CASE(Resize)
+{
+    CThreadPool& pool = CThreadPool::Get();
+
+    // The new size is used when the pool restarts.
+    pool.SetSize(2);
+    BOOST_CHECK_EQUAL(pool.GetSize(), 2u);
+
+    std::atomic<unsigned int> total{0};
+    pool.Run(16, [&](unsigned int) { total++; });
+    BOOST_CHECK_EQUAL(total.load(), 16u);
+
+    // The pool restarts lazily after a shutdown.
+    pool.Shutdown();
+    pool.Run(16, [&](unsigned int) { total++; });
+    BOOST_CHECK_EQUAL(total.load(), 32u);
+
+    // Restore the default size.
+    pool.SetSize(0);
+}
+
+// Test case for resizing the pool while a batch is running.
+BOOST_AUTO_TEST_CASE(ResizeDuringRun)
+{
+    CThreadPool& pool = CThreadPool::Get();
+
+    // A task may resize the pool, the batch still completes.
+    std::atomic<unsigned int> total{0};
+    pool.Run(8, [&](unsigned int i) {
+        if (i == 0) {
+            pool.SetSize(3);
+        }
+        total++;
+    });
+    BOOST_CHECK_EQUAL(total.load(), 8u);
+    BOOST_CHECK_EQUAL(pool.GetSize(), 3u);
+
+    // The workers were restarted with the new size once the batch returned.
+    std::mutex mutex;
+    std::set<std::thread::id> threads;
+    pool.Run(4, [&](unsigned int) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        std::lock_guard<std::mutex> lock(mutex);
+        threads.insert(std::this_thread::get_id());
+    });
+    BOOST_CHECK_EQUAL(threads.size(), 4u);
+
+    // Restore the default size.
+    pool.SetSize(0);
+}
+
+// Test case for running tasks while the pool is being shut down.
+BOOST_AUTO_TEST_CASE(RunDuringShutdown)
+{
+    CThreadPool& pool = CThreadPool::Get();
+
+    // Keep a worker busy, so the shutdown below waits for it to finish its task.
+    std::thread busy([&]() {
+        pool.Run(2, [&](unsigned int) { std::this_thread::sleep_for(std::chrono::milliseconds(200)); });
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    std::thread stopper([&]() { pool.Shutdown(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    // A batch arriving while the workers are being stopped still runs.
+    std::atomic<unsigned int> total{0};
+    pool.Run(4, [&](unsigned int) { total++; });
+    BOOST_CHECK_EQUAL(total.load(), 4u);
+
+    stopper.join();
+    busy.join();
+
+    // Workers run tasks again afterwards, instead of the calling thread alone.
+    std::mutex mutex;
+    std::set<std::thread::id> threads;
+    pool.Run(2, [&](unsigned int) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        std::lock_guard<std::mutex> lock(mutex);
+        threads.insert(std::this_thread::get_id());
+    });
+    BOOST_CHECK_EQUAL(threads.size(), 2u);
+}
+
+// Test case for shutting the pool down from several threads at once.
+BOOST_AUTO_TEST_CASE(ConcurrentShutdown)
+{
+    CThreadPool& pool = CThreadPool::Get();
+
+    for (int round = 0; round < 100; ++round) {
+        // Start the workers, then stop them from competing threads.
+        std::atomic<unsigned int> total{0};
+        pool.Run(8, [&](unsigned int) { total++; });
+        BOOST_CHECK_EQUAL(total.load(), 8u);
+
+        pool.Attach();
+        std::vector<std::thread> stoppers;
+        stoppers.emplace_back([&]() { pool.Detach(); });
+        for (int i = 0; i < 3; ++i) {
+            stoppers.emplace_back([&]() { pool.Shutdown(); });
+        }
+
+        // Every shutdown returns, which it does not when one of them clears the
+        // stop flag while another is joining the workers.
+        for (auto& stopper : stoppers) {
+            stopper.join();
+        }
+    }
+
+    // The pool still runs tasks afterwards.
+    std::atomic<unsigned int> total{0};
+    pool.Run(16, [&](unsigned int) { total++; });
+    BOOST_CHECK_EQUAL(total.load(), 16u);
+}
+
+// End of test suite for CThreadPool class.
+BOOST_AUTO_TEST_SUITE_END()
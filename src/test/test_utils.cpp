@@ -0,0 +1,104 @@
+// Copyright (c) 2024 Marco Fortina
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#include <test.h>
+
+#include <utils.h>
+
+// IWYU pragma: no_include <boost/preprocessor/arithmetic/limits/dec_256.hpp>
+// IWYU pragma: no_include <boost/preprocessor/comparison/limits/not_equal_256.hpp>
+// IWYU pragma: no_include <boost/preprocessor/control/expr_iif.hpp>
+// IWYU pragma: no_include <boost/preprocessor/control/iif.hpp>
+// IWYU pragma: no_include <boost/preprocessor/detail/limits/auto_rec_256.hpp>
+// IWYU pragma: no_include <boost/preprocessor/logical/compl.hpp>
+// IWYU pragma: no_include <boost/preprocessor/logical/limits/bool_256.hpp>
+// IWYU pragma: no_include <boost/preprocessor/repetition/detail/limits/for_256.hpp>
+// IWYU pragma: no_include <boost/preprocessor/repetition/for.hpp>
+// IWYU pragma: no_include <boost/preprocessor/seq/limits/elem_256.hpp>
+// IWYU pragma: no_include <boost/preprocessor/seq/limits/size_256.hpp>
+// IWYU pragma: no_include <boost/preprocessor/tuple/elem.hpp>
+// IWYU pragma: no_include <boost/preprocessor/variadic/limits/elem_64.hpp>
+// IWYU pragma: no_include <boost/test/tools/old/interface.hpp>
+// IWYU pragma: no_include <boost/test/tree/auto_registration.hpp>
+// IWYU pragma: no_include <boost/test/unit_test_suite.hpp>
+// IWYU pragma: no_include <boost/test/utils/basic_cstring/basic_cstring.hpp>
+// IWYU pragma: no_include <boost/test/utils/lazy_ostream.hpp>
+
+#include <boost/test/unit_test.hpp> // IWYU pragma: keep
+#include <cstdint>
+#include <random>
+#include <vector>
+
+// Define a test suite for testing the utility functions.
+BOOST_FIXTURE_TEST_SUITE(TestUtils, BasicTestingSetup)
+
+// Test case for the known output of Pack12.
+BOOST_AUTO_TEST_CASE(Pack12Vectors)
+{
+    // Three bytes give two values, lower 12 bits first.
+    BOOST_CHECK(Pack12({0x21, 0x43, 0x65}) == std::vector<uint16_t>({0x321, 0x654}));
+
+    // Incomplete groups are padded with zeros.
+    BOOST_CHECK(Pack12({0xFF}) == std::vector<uint16_t>({0x0FF, 0x000}));
+    BOOST_CHECK(Pack12({0xFF, 0xFF}) == std::vector<uint16_t>({0xFFF, 0x00F}));
+    BOOST_CHECK(Pack12({}).empty() == true);
+}
+
+// Test case for the generic bit unpacker.
+BOOST_AUTO_TEST_CASE(PackBitsWidths)
+{
+    std::mt19937 rng(16);
+
+    // 12-bit values are those of Pack12.
+    for (std::size_t size = 0; size < 50; ++size) {
+        std::vector<unsigned char> input(size);
+        for (unsigned char& byte : input) {
+            byte = static_cast<unsigned char>(rng());
+        }
+
+        BOOST_CHECK(PackBits<12>(input) == Pack12Reference(input));
+        BOOST_CHECK_EQUAL(PackBits<12>(input).size(), GetPackBitsCount<12>(size));
+    }
+
+    // Values are read LSB first, 5 bytes hold four 10-bit values.
+    BOOST_CHECK(PackBits<10>({0xFF, 0x03, 0x00, 0x00, 0xC0}) == std::vector<uint16_t>({0x3FF, 0x000, 0x000, 0x300}));
+    BOOST_CHECK_EQUAL(GetPackBitsCount<10>(6), 8);
+
+    // 16-bit values are little-endian words, an odd byte is zero padded.
+    BOOST_CHECK(PackBits<16>({0x34, 0x12, 0x78}) == std::vector<uint16_t>({0x1234, 0x0078}));
+}
+
+// Test case for the SIMD kernels against the reference implementation.
+BOOST_AUTO_TEST_CASE(Pack12Kernels)
+{
+    std::mt19937 rng(12);
+
+    // The dispatched kernel must be usable.
+    BOOST_CHECK(IsPack12KernelSupported(GetPack12Kernel()) == true);
+
+    for (std::size_t size = 0; size < 200; ++size) {
+        std::vector<unsigned char> input(size);
+        for (unsigned char& byte : input) {
+            byte = static_cast<unsigned char>(rng());
+        }
+
+        std::vector<uint16_t> expected = Pack12Reference(input);
+        BOOST_CHECK(Pack12(input) == expected);
+
+        // Every kernel supported by this CPU must be bit-identical.
+        for (Pack12Kernel kernel : {Pack12Kernel::SCALAR, Pack12Kernel::SSE41, Pack12Kernel::AVX2}) {
+            if (!IsPack12KernelSupported(kernel)) {
+                continue;
+            }
+
+            std::size_t numGroups = size / 3;
+            std::vector<uint16_t> output(numGroups * 2);
+            Unpack12Groups(input.data(), numGroups, output.data(), kernel);
+            BOOST_CHECK(std::vector<uint16_t>(expected.begin(), expected.begin() + numGroups * 2) == output);
+        }
+    }
+}
+
+// End of test suite for the utility functions.
+BOOST_AUTO_TEST_SUITE_END()
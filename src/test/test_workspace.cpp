@@ -0,0 +1,113 @@
+// Copyright (c) 2024 Marco Fortina
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#include <test.h>
+
+#include <workspace.h>
+
+// IWYU pragma: no_include <boost/preprocessor/arithmetic/limits/dec_256.hpp>
+// IWYU pragma: no_include <boost/preprocessor/comparison/limits/not_equal_256.hpp>
+// IWYU pragma: no_include <boost/preprocessor/control/expr_iif.hpp>
+// IWYU pragma: no_include <boost/preprocessor/control/iif.hpp>
+// IWYU pragma: no_include <boost/preprocessor/detail/limits/auto_rec_256.hpp>
+// IWYU pragma: no_include <boost/preprocessor/logical/compl.hpp>
+// IWYU pragma: no_include <boost/preprocessor/logical/limits/bool_256.hpp>
+// IWYU pragma: no_include <boost/preprocessor/repetition/detail/limits/for_256.hpp>
+// IWYU pragma: no_include <boost/preprocessor/repetition/for.hpp>
+// IWYU pragma: no_include <boost/preprocessor/seq/limits/elem_256.hpp>
+// IWYU pragma: no_include <boost/preprocessor/seq/limits/size_256.hpp>
+// IWYU pragma: no_include <boost/preprocessor/tuple/elem.hpp>
+// IWYU pragma: no_include <boost/preprocessor/variadic/limits/elem_64.hpp>
+// IWYU pragma: no_include <boost/test/tools/old/interface.hpp>
+// IWYU pragma: no_include <boost/test/tree/auto_registration.hpp>
+// IWYU pragma: no_include <boost/test/unit_test_suite.hpp>
+// IWYU pragma: no_include <boost/test/utils/basic_cstring/basic_cstring.hpp>
+// IWYU pragma: no_include <boost/test/utils/lazy_ostream.hpp>
+
+#include <boost/test/unit_test.hpp> // IWYU pragma: keep
+#include <set>
+#include <vector>
+
+// Define a test suite for testing the CWorkspacePool class.
+BOOST_FIXTURE_TEST_SUITE(TestCWorkspacePool, ExtendedTestingSetup)
+
+// Test case for reserving, acquiring and releasing workspaces.
+BOOST_AUTO_TEST_CASE(AcquireRelease)
+{
+    CWorkspacePool& pool = CWorkspacePool::Get();
+
+    // Reserved workspaces are available without allocating.
+    pool.Reserve(4);
+    BOOST_CHECK(pool.GetAvailable() >= 4);
+
+    std::size_t size = pool.GetSize();
+    std::size_t available = pool.GetAvailable();
+
+    // Every acquired workspace is distinct.
+    std::set<CWorkspace*> acquired;
+    for (int i = 0; i < 4; ++i) {
+        acquired.insert(pool.Acquire());
+    }
+    BOOST_CHECK_EQUAL(acquired.size(), 4);
+    BOOST_CHECK_EQUAL(pool.GetAvailable(), available - 4);
+
+    // A released workspace is reset and handed out again.
+    CWorkspace* workspace = *acquired.begin();
+    BOOST_CHECK(workspace->graph.AddEdge(1, 2) == true);
+    BOOST_CHECK(workspace->path.FindLongestPath(workspace->graph) == std::vector<uint16_t>({1, 2}));
+
+    pool.Release(workspace);
+    CWorkspace* reused = pool.Acquire();
+    BOOST_CHECK(reused == workspace);
+    BOOST_CHECK(reused->graph.HasEdge(1, 2) == false);
+    BOOST_CHECK_EQUAL(reused->path.Size(), 0);
+
+    for (CWorkspace* ws : acquired) {
+        pool.Release(ws);
+    }
+
+    // Nothing was allocated beyond the reservation.
+    BOOST_CHECK_EQUAL(pool.GetSize(), size);
+    BOOST_CHECK_EQUAL(pool.GetAvailable(), available);
+
+    // The pool grows on demand once the reservation is used up.
+    std::vector<CWorkspace*> extra;
+    for (std::size_t i = 0; i <= available; ++i) {
+        extra.push_back(pool.Acquire());
+    }
+    BOOST_CHECK_EQUAL(pool.GetSize(), size + 1);
+
+    for (CWorkspace* ws : extra) {
+        pool.Release(ws);
+    }
+}
+
+// Test case for a released workspace forgetting its previous user.
+BOOST_AUTO_TEST_CASE(ReleaseWipes)
+{
+    CWorkspacePool& pool = CWorkspacePool::Get();
+
+    CWorkspace* workspace = pool.Acquire();
+    BOOST_CHECK(workspace->graph.Initialize(publicKey, secretKey) == true);
+    workspace->graph.SetHeader(header);
+    workspace->graph.SetNonce(nonce);
+    BOOST_CHECK(workspace->graph.Generate() == true);
+
+    BOOST_CHECK(workspace->graph.GetEncMessage().empty() == false);
+    BOOST_CHECK(workspace->graph.GetIV().empty() == false);
+
+    pool.Release(workspace);
+    CWorkspace* reused = pool.Acquire();
+    BOOST_CHECK(reused == workspace);
+
+    // Nothing of the previous user is left, as in a new graph.
+    BOOST_CHECK(reused->graph.GetEncMessage().empty() == true);
+    BOOST_CHECK(reused->graph.GetIV().empty() == true);
+    BOOST_CHECK(reused->graph.GetCiphertext() == std::vector<unsigned char>(OQS_KEM_kyber_768_length_ciphertext, 0));
+
+    pool.Release(reused);
+}
+
+// End of test suite for CWorkspacePool class.
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,208 @@
+// Copyright (c) 2024 Marco Fortina
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#include <threadpool.h>
+
+#include <algorithm>
+
+// Retrieves the pool shared by the whole library.
+CThreadPool& CThreadPool::Get()
+{
+    static CThreadPool pool;
+    return pool;
+}
+
+// Stops the workers and destroys the pool.
+CThreadPool::~CThreadPool()
+{
+    Shutdown();
+}
+
+// Sets the number of worker threads.
+void CThreadPool::SetSize(unsigned int numThreads)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        nSize = numThreads;
+
+        // Leave the workers to the running batches, the last one restarts them
+        if (nRuns > 0) {
+            fResizePending = true;
+            return;
+        }
+    }
+
+    // Stop the current workers, the new size is applied lazily
+    Shutdown();
+}
+
+// Gets the number of worker threads used by the pool.
+unsigned int CThreadPool::GetSize() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    return nSize > 0 ? nSize : DefaultSize();
+}
+
+// Gets the default number of worker threads.
+unsigned int CThreadPool::DefaultSize()
+{
+    // Keep one core for the calling thread, which also runs tasks
+    unsigned int numCores = std::thread::hardware_concurrency();
+    return numCores > 1 ? numCores - 1 : 1;
+}
+
+// Starts the worker threads if they are not running (mutex must be held).
+void CThreadPool::Start()
+{
+    // Workers started during a shutdown would exit at once and never be replaced,
+    // so leave the pool stopped; the caller runs its tasks itself meanwhile
+    if (fStop || !workers.empty()) {
+        return;
+    }
+
+    unsigned int numThreads = nSize > 0 ? nSize : DefaultSize();
+
+    workers.reserve(numThreads);
+    for (unsigned int i = 0; i < numThreads; ++i) {
+        workers.emplace_back(&CThreadPool::WorkerThread, this);
+    }
+}
+
+// Claims and runs task indices until none is left.
+void CThreadPool::CJob::Work()
+{
+    for (unsigned int i = nNext.fetch_add(1); i < nTasks; i = nNext.fetch_add(1)) {
+        task(i);
+
+        // The thread completing the last task wakes up the submitter
+        if (nDone.fetch_add(1) + 1 == nTasks) {
+            std::lock_guard<std::mutex> lock(mutex);
+            cvDone.notify_all();
+        }
+    }
+}
+
+// Main loop of a worker thread.
+void CThreadPool::WorkerThread()
+{
+    while (true) {
+        std::shared_ptr<CJob> job;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cvWork.wait(lock, [this] { return fStop || !jobs.empty(); });
+
+            if (fStop) {
+                return;
+            }
+
+            // Retire jobs whose tasks have all been claimed
+            job = jobs.front();
+            if (job->nNext.load() >= job->nTasks) {
+                jobs.pop_front();
+                continue;
+            }
+        }
+
+        job->Work();
+    }
+}
+
+// Runs a task for every index in [0, numTasks) and waits for completion.
+void CThreadPool::Run(unsigned int numTasks, const std::function<void(unsigned int)>& task)
+{
+    // Nothing to share with the workers
+    if (numTasks <= 1) {
+        for (unsigned int i = 0; i < numTasks; ++i) {
+            task(i);
+        }
+        return;
+    }
+
+    auto job = std::make_shared<CJob>(task, numTasks);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Start();
+        jobs.push_back(job);
+        ++nRuns;
+    }
+    cvWork.notify_all();
+
+    // The calling thread works on its own job too
+    job->Work();
+
+    // Wait for the tasks claimed by the workers
+    {
+        std::unique_lock<std::mutex> lock(job->mutex);
+        job->cvDone.wait(lock, [&job] { return job->nDone.load() == job->nTasks; });
+    }
+
+    bool fResize = false;
+
+    {
+        // Drop the job if no worker retired it yet
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = std::find(jobs.begin(), jobs.end(), job);
+        if (it != jobs.end()) {
+            jobs.erase(it);
+        }
+
+        // Apply a resize requested while batches were running. A nested Run()
+        // returns before its parent, so this never runs on a worker thread.
+        if (--nRuns == 0 && fResizePending) {
+            fResizePending = false;
+            fResize = true;
+        }
+    }
+
+    if (fResize) {
+        Shutdown();
+    }
+}
+
+// Stops and joins the worker threads.
+void CThreadPool::Shutdown()
+{
+    // A second shutdown clearing fStop while the first one joins would put its
+    // workers back to sleep, so shutdowns run one at a time
+    std::lock_guard<std::mutex> shutdownLock(shutdownMutex);
+
+    std::vector<std::thread> stopping;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        fStop = true;
+        stopping.swap(workers);
+    }
+    cvWork.notify_all();
+
+    for (auto& worker : stopping) {
+        worker.join();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    fStop = false;
+}
+
+// Registers a user of the pool.
+void CThreadPool::Attach()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    ++nUsers;
+}
+
+// Unregisters a user of the pool, shutting it down after the last one.
+void CThreadPool::Detach()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (nUsers == 0 || --nUsers > 0) {
+            return;
+        }
+    }
+
+    Shutdown();
+}
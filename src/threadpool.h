@@ -0,0 +1,173 @@
+// Copyright (c) 2024 Marco Fortina
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#ifndef QYRA_THREADPOOL_H
+#define QYRA_THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief A long-lived pool of worker threads owned by the library.
+ *
+ * Workers are started lazily on the first Run() and stay alive across calls, so
+ * a parallel search does not pay for creating and joining threads every time.
+ * The pool is shut down when the last CQYRA instance releases it, or at exit.
+ */
+class CThreadPool
+{
+public:
+    /**
+     * @brief Retrieves the pool shared by the whole library.
+     *
+     * @return A reference to the shared pool.
+     */
+    static CThreadPool& Get();
+
+    /**
+     * @brief Stops the workers and destroys the pool.
+     */
+    ~CThreadPool();
+
+    CThreadPool(const CThreadPool&) = delete;
+    CThreadPool& operator=(const CThreadPool&) = delete;
+
+    /**
+     * @brief Sets the number of worker threads.
+     *
+     * Running workers are stopped and the new size takes effect on the next Run().
+     * While Run() calls are in progress, the workers are replaced once the last of
+     * them returns, so it may be called at any time, even from a task.
+     *
+     * @param numThreads Number of worker threads, not counting the calling thread
+     *                   which also runs tasks. Zero selects the default size.
+     */
+    void SetSize(unsigned int numThreads);
+
+    /**
+     * @brief Gets the number of worker threads used by the pool.
+     *
+     * @return The number of worker threads.
+     */
+    unsigned int GetSize() const;
+
+    /**
+     * @brief Runs a task for every index in [0, numTasks) and waits for completion.
+     *
+     * The calling thread takes part in the work, so Run() may be nested inside a
+     * task without deadlocking. Tasks must not throw.
+     *
+     * @param numTasks Number of task indices to run.
+     * @param task Function called once for each index.
+     */
+    void Run(unsigned int numTasks, const std::function<void(unsigned int)>& task);
+
+    /**
+     * @brief Stops and joins the worker threads.
+     *
+     * The pool restarts lazily on the next Run().
+     */
+    void Shutdown();
+
+    /**
+     * @brief Registers a user of the pool.
+     */
+    void Attach();
+
+    /**
+     * @brief Unregisters a user of the pool, shutting it down after the last one.
+     */
+    void Detach();
+
+private:
+    /**
+     * @brief A batch of tasks submitted by a single Run() call.
+     */
+    struct CJob {
+        ///< Function called for each task index.
+        const std::function<void(unsigned int)>& task;
+
+        ///< Number of task indices.
+        unsigned int nTasks;
+
+        ///< Next task index to be claimed.
+        std::atomic<unsigned int> nNext{0};
+
+        ///< Number of completed tasks.
+        std::atomic<unsigned int> nDone{0};
+
+        ///< Protects the completion notification.
+        std::mutex mutex;
+
+        ///< Signaled when all tasks have completed.
+        std::condition_variable cvDone;
+
+        CJob(const std::function<void(unsigned int)>& task, unsigned int nTasks) : task(task), nTasks(nTasks) {}
+
+        /**
+         * @brief Claims and runs task indices until none is left.
+         */
+        void Work();
+    };
+
+    CThreadPool() = default;
+
+    /**
+     * @brief Gets the default number of worker threads.
+     *
+     * @return The number of cores minus the one used by the calling thread, at least 1.
+     */
+    static unsigned int DefaultSize();
+
+    /**
+     * @brief Starts the worker threads if they are not running (mutex must be held).
+     *
+     * Nothing is started while a shutdown is in progress; the next Run() after it
+     * starts the workers.
+     */
+    void Start();
+
+    /**
+     * @brief Main loop of a worker thread.
+     */
+    void WorkerThread();
+
+    ///< Serializes Shutdown() calls, held until fStop is cleared.
+    std::mutex shutdownMutex;
+
+    ///< Protects the members below.
+    mutable std::mutex mutex;
+
+    ///< Signaled when a job is queued or the pool is stopping.
+    std::condition_variable cvWork;
+
+    ///< Jobs that may still have unclaimed tasks.
+    std::deque<std::shared_ptr<CJob>> jobs;
+
+    ///< Running worker threads.
+    std::vector<std::thread> workers;
+
+    ///< Requested number of worker threads (0 selects the default).
+    unsigned int nSize = 0;
+
+    ///< Number of registered users.
+    unsigned int nUsers = 0;
+
+    ///< Number of Run() calls sharing their tasks with the workers.
+    unsigned int nRuns = 0;
+
+    ///< True if SetSize() was called during a Run(), the last one to return restarts the workers.
+    bool fResizePending = false;
+
+    ///< True while the workers are being stopped.
+    bool fStop = false;
+};
+
+#endif // QYRA_THREADPOOL_H
@@ -5,6 +5,9 @@
 #include <utils.h>
 
 #include <ctime>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 #include <endian.h>
 #include <iomanip>
 #include <sstream>
@@ -61,8 +64,8 @@ std::vector<unsigned char> ParseHex(const std::string& str)
     return result;
 }
 
-// Packs a vector of unsigned char into a vector of uint16_t using 12-bit groups.
-std::vector<uint16_t> Pack12(const std::vector<unsigned char>& input)
+// Reference implementation of Pack12(), one group of 3 bytes at a time.
+std::vector<uint16_t> Pack12Reference(const std::vector<unsigned char>& input)
 {
     std::vector<unsigned char> paddedInput = input;
 
@@ -99,6 +102,135 @@ std::vector<uint16_t> Pack12(const std::vector<unsigned char>& input)
     return output;
 }
 
+// Decodes whole groups of 3 bytes with portable scalar code.
+static void Unpack12GroupsScalar(const unsigned char* data, std::size_t numGroups, uint16_t* output)
+{
+    ForEachPack12(data, numGroups * 3, [&output](uint16_t value) {
+        *output++ = value;
+        return true;
+    });
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// Byte pairs holding each 12-bit value of 4 groups: (b0, b1) for the lower
+// value and (b1, b2) for the higher one.
+#define PACK12_SHUFFLE 0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11
+
+// Decodes whole groups of 3 bytes with SSE4.1, 4 groups per iteration.
+__attribute__((target("sse4.1"))) static void Unpack12GroupsSSE41(const unsigned char* data, std::size_t numGroups, uint16_t* output)
+{
+    const __m128i shuffle = _mm_setr_epi8(PACK12_SHUFFLE);
+    const __m128i mask = _mm_set1_epi16(0x0FFF);
+
+    // Each iteration loads 16 bytes but consumes 12, stop before reading past the end
+    std::size_t i = 0;
+    for (; i + 6 <= numGroups; i += 4) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i * 3));
+        __m128i words = _mm_shuffle_epi8(bytes, shuffle);
+
+        // Lower values keep the low 12 bits, higher values drop the low nibble
+        __m128i values = _mm_blend_epi16(_mm_and_si128(words, mask), _mm_srli_epi16(words, 4), 0xAA);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i * 2), values);
+    }
+
+    Unpack12GroupsScalar(data + i * 3, numGroups - i, output + i * 2);
+}
+
+// Decodes whole groups of 3 bytes with AVX2, 8 groups per iteration.
+__attribute__((target("avx2"))) static void Unpack12GroupsAVX2(const unsigned char* data, std::size_t numGroups, uint16_t* output)
+{
+    const __m256i shuffle = _mm256_setr_epi8(PACK12_SHUFFLE, PACK12_SHUFFLE);
+    const __m256i mask = _mm256_set1_epi16(0x0FFF);
+
+    // Each iteration loads 12 bytes into each 128-bit lane, reading 28 bytes
+    // for 24 consumed, stop before reading past the end
+    std::size_t i = 0;
+    for (; i + 10 <= numGroups; i += 8) {
+        const unsigned char* p = data + i * 3;
+        __m256i bytes = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))),
+                                                _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 12)), 1);
+        __m256i words = _mm256_shuffle_epi8(bytes, shuffle);
+
+        // Lower values keep the low 12 bits, higher values drop the low nibble
+        __m256i values = _mm256_blend_epi16(_mm256_and_si256(words, mask), _mm256_srli_epi16(words, 4), 0xAA);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(output + i * 2), values);
+    }
+
+    Unpack12GroupsSSE41(data + i * 3, numGroups - i, output + i * 2);
+}
+
+#undef PACK12_SHUFFLE
+#endif
+
+// Checks whether a 12-bit decoding kernel can run on this CPU.
+bool IsPack12KernelSupported(Pack12Kernel kernel)
+{
+    switch (kernel) {
+    case Pack12Kernel::SCALAR:
+        return true;
+#if defined(__x86_64__) || defined(__i386__)
+    case Pack12Kernel::SSE41:
+        return __builtin_cpu_supports("sse4.1");
+    case Pack12Kernel::AVX2:
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+// Gets the fastest 12-bit decoding kernel supported by this CPU.
+Pack12Kernel GetPack12Kernel()
+{
+    static const Pack12Kernel kernel = [] {
+        for (Pack12Kernel candidate : {Pack12Kernel::AVX2, Pack12Kernel::SSE41}) {
+            if (IsPack12KernelSupported(candidate)) {
+                return candidate;
+            }
+        }
+        return Pack12Kernel::SCALAR;
+    }();
+
+    return kernel;
+}
+
+// Decodes whole groups of 3 bytes into pairs of 12-bit values.
+void Unpack12Groups(const unsigned char* data, std::size_t numGroups, uint16_t* output, Pack12Kernel kernel)
+{
+    switch (kernel) {
+#if defined(__x86_64__) || defined(__i386__)
+    case Pack12Kernel::AVX2:
+        Unpack12GroupsAVX2(data, numGroups, output);
+        break;
+    case Pack12Kernel::SSE41:
+        Unpack12GroupsSSE41(data, numGroups, output);
+        break;
+#endif
+    default:
+        Unpack12GroupsScalar(data, numGroups, output);
+        break;
+    }
+}
+
+// Packs a vector of unsigned char into a vector of uint16_t using 12-bit groups.
+std::vector<uint16_t> Pack12(const std::vector<unsigned char>& input)
+{
+    // Two values for every 3 bytes, the last group being zero padded
+    std::vector<uint16_t> output((input.size() + 2) / 3 * 2);
+
+    // Decode the whole groups with the fastest kernel
+    std::size_t numGroups = input.size() / 3;
+    Unpack12Groups(input.data(), numGroups, output.data());
+
+    // Decode the zero padded tail, if any
+    ForEachPack12(input.data() + numGroups * 3, input.size() - numGroups * 3, [&output, i = numGroups * 2](uint16_t value) mutable {
+        output[i++] = value;
+        return true;
+    });
+
+    return output;
+}
+
 // Function to get the current Unix timestamp
 uint32_t GetTime()
 {
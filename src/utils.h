@@ -7,6 +7,8 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <endian.h>
+#include <numeric>
 #include <string>
 #include <vector>
 
@@ -57,7 +59,8 @@ std::vector<unsigned char> ParseHex(const std::string& str);
  *
  * This function pads the input vector with zeros to ensure its size
  * is divisible by 3, then processes the input in groups of 12 bits,
- * converting each group into uint16_t.
+ * converting each group into uint16_t. The bulk of the input is decoded
+ * by the fastest kernel supported by the CPU (see GetPack12Kernel()).
  *
  * @param input A vector of unsigned char to be packed.
  * @return A vector of uint16_t resulting from the packing process.
@@ -65,6 +68,178 @@ std::vector<unsigned char> ParseHex(const std::string& str);
  */
 std::vector<uint16_t> Pack12(const std::vector<unsigned char>& input);
 
+/**
+ * @brief Gets the number of values decoded from a byte buffer by PackBits().
+ *
+ * @tparam Bits Number of bits of a value (1 to 16).
+ * @param size Number of bytes to decode.
+ * @return The number of values, counting those of the zero padding.
+ */
+template <unsigned int Bits>
+constexpr std::size_t GetPackBitsCount(std::size_t size)
+{
+    // Smallest number of bytes holding a whole number of values
+    constexpr std::size_t GROUP_BYTES = std::lcm(Bits, 8u) / 8;
+
+    return (size + GROUP_BYTES - 1) / GROUP_BYTES * (GROUP_BYTES * 8 / Bits);
+}
+
+/**
+ * @brief Decodes the values of a byte buffer read as an LSB-first bit stream, without copying it.
+ *
+ * Value k is made of bits [k * Bits, (k + 1) * Bits) of the buffer, where bit i is
+ * bit (i % 8) of byte (i / 8). The buffer is read as if it were padded with zeros
+ * to the smallest multiple of bytes holding a whole number of values, so for 12
+ * bits the values are exactly those returned by Pack12() on little-endian hosts.
+ *
+ * @tparam Bits Number of bits of a value (1 to 16).
+ * @tparam Function Callable taking a uint16_t and returning false to stop decoding.
+ * @param data Pointer to the bytes to decode.
+ * @param size Number of bytes to decode.
+ * @param fn Function called with each value, in order.
+ * @return True if every value was decoded, false if fn stopped the decoding.
+ */
+template <unsigned int Bits, typename Function>
+bool ForEachPackBits(const unsigned char* data, std::size_t size, Function&& fn)
+{
+    static_assert(Bits >= 1 && Bits <= 16, "Values must fit in uint16_t");
+
+    // Smallest number of bytes holding a whole number of values
+    constexpr std::size_t GROUP_BYTES = std::lcm(Bits, 8u) / 8;
+
+    // Bits read but not yet decoded, never more than Bits + 7
+    uint32_t buffer = 0;
+    unsigned int numBits = 0;
+
+    std::size_t paddedSize = (size + GROUP_BYTES - 1) / GROUP_BYTES * GROUP_BYTES;
+    for (std::size_t i = 0; i < paddedSize; ++i) {
+        buffer |= static_cast<uint32_t>(i < size ? data[i] : 0) << numBits;
+        numBits += 8;
+
+        while (numBits >= Bits) {
+            if (!fn(static_cast<uint16_t>(buffer & ((1u << Bits) - 1)))) {
+                return false;
+            }
+
+            buffer >>= Bits;
+            numBits -= Bits;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Packs a vector of unsigned char into a vector of uint16_t using groups of Bits bits.
+ *
+ * This is the generic form of Pack12(), see ForEachPackBits() for the layout.
+ *
+ * @tparam Bits Number of bits of a value (1 to 16).
+ * @param input A vector of unsigned char to be packed.
+ * @return A vector of uint16_t resulting from the packing process.
+ */
+template <unsigned int Bits>
+std::vector<uint16_t> PackBits(const std::vector<unsigned char>& input)
+{
+    std::vector<uint16_t> output;
+    output.reserve(GetPackBitsCount<Bits>(input.size()));
+
+    ForEachPackBits<Bits>(input.data(), input.size(), [&output](uint16_t value) {
+        output.push_back(value);
+        return true;
+    });
+
+    return output;
+}
+
+/**
+ * @brief Reference implementation of Pack12(), one group of 3 bytes at a time.
+ *
+ * @param input A vector of unsigned char to be packed.
+ * @return A vector of uint16_t resulting from the packing process.
+ */
+std::vector<uint16_t> Pack12Reference(const std::vector<unsigned char>& input);
+
+/**
+ * @brief Implementations of the 12-bit decoding kernel.
+ */
+enum class Pack12Kernel {
+    SCALAR, ///< Portable scalar code.
+    SSE41,  ///< SSE4.1, 12 bytes into 8 values per iteration.
+    AVX2,   ///< AVX2, 24 bytes into 16 values per iteration.
+};
+
+/**
+ * @brief Checks whether a 12-bit decoding kernel can run on this CPU.
+ *
+ * @param kernel The kernel to check.
+ * @return True if the kernel is supported, false otherwise.
+ */
+bool IsPack12KernelSupported(Pack12Kernel kernel);
+
+/**
+ * @brief Gets the fastest 12-bit decoding kernel supported by this CPU.
+ *
+ * The CPU is probed once, on the first call.
+ *
+ * @return The kernel used by Pack12() and Unpack12Groups().
+ */
+Pack12Kernel GetPack12Kernel();
+
+/**
+ * @brief Decodes whole groups of 3 bytes into pairs of 12-bit values.
+ *
+ * @param data Pointer to numGroups * 3 bytes to decode.
+ * @param numGroups Number of groups to decode.
+ * @param output Pointer to room for numGroups * 2 values.
+ * @param kernel The kernel to use, which must be supported.
+ */
+void Unpack12Groups(const unsigned char* data, std::size_t numGroups, uint16_t* output, Pack12Kernel kernel = GetPack12Kernel());
+
+/**
+ * @brief Decodes the 12-bit groups of a byte buffer in place, without copying it.
+ *
+ * The values are exactly those returned by Pack12(): the buffer is read as if it
+ * were padded with zeros to a multiple of 3 bytes, and every 3 bytes yield two
+ * values (lower 12 bits first).
+ *
+ * @tparam Function Callable taking a uint16_t and returning false to stop decoding.
+ * @param data Pointer to the bytes to decode.
+ * @param size Number of bytes to decode.
+ * @param fn Function called with each value, in order.
+ * @return True if every value was decoded, false if fn stopped the decoding.
+ */
+template <typename Function>
+bool ForEachPack12(const unsigned char* data, std::size_t size, Function&& fn)
+{
+    for (std::size_t i = 0; i < size; i += 3) {
+        // Combine three bytes into a 24-bit value, missing bytes count as zero padding
+        uint32_t value = static_cast<uint32_t>(data[i]);
+        if (i + 1 < size) {
+            value |= static_cast<uint32_t>(data[i + 1]) << 8;
+        }
+        if (i + 2 < size) {
+            value |= static_cast<uint32_t>(data[i + 2]) << 16;
+        }
+
+        // Extract two 12-bit values from the 24-bit value
+        uint16_t low = static_cast<uint16_t>(value & 0x0FFF);          // Lower 12 bits
+        uint16_t high = static_cast<uint16_t>((value >> 12) & 0x0FFF); // Higher 12 bits
+
+        // If the system is big-endian, convert the values to little-endian
+#if __BYTE_ORDER == __BIG_ENDIAN
+        low = htole16(low);
+        high = htole16(high);
+#endif
+
+        if (!fn(low) || !fn(high)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 /**
  * @brief Retrieves the current Unix timestamp.
  *
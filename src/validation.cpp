@@ -0,0 +1,74 @@
+// Copyright (c) 2024 Marco Fortina
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#include <validation.h>
+
+// Weight of a new measurement in the moving average, as a power of two (1/8).
+static constexpr unsigned int COST_AVERAGE_SHIFT = 3;
+
+// Cost assumed for a stage before its first measurement, in nanoseconds, by stage.
+// They are set on the high side of a Kyber-768 decapsulation and of a graph search,
+// so a budget is enforced from the very first solution.
+static constexpr uint64_t DEFAULT_STAGE_COSTS[NUM_VALIDATION_STAGES] = {
+    0,      // STRUCTURE
+    200000, // ENCRYPTION
+    100000, // PATH
+};
+
+// Retrieves the costs shared by the whole library.
+CValidationCosts& CValidationCosts::Get()
+{
+    static CValidationCosts costs;
+    return costs;
+}
+
+// Records a run of a stage.
+void CValidationCosts::Record(ValidationStage stage, uint64_t nCost, bool fRejected)
+{
+    CCounters& stageCounters = counters[static_cast<std::size_t>(stage)];
+
+    stageCounters.nRuns.fetch_add(1, std::memory_order_relaxed);
+    if (fRejected) {
+        stageCounters.nRejects.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // The first measurement seeds the average, later ones are blended in
+    uint64_t nAverage = stageCounters.nAverageCost.load(std::memory_order_relaxed);
+    uint64_t nNewAverage;
+    do {
+        nNewAverage = nAverage == 0 ? nCost : nAverage - (nAverage >> COST_AVERAGE_SHIFT) + (nCost >> COST_AVERAGE_SHIFT);
+    } while (!stageCounters.nAverageCost.compare_exchange_weak(nAverage, nNewAverage, std::memory_order_relaxed));
+}
+
+// Gets the expected cost of a stage.
+uint64_t CValidationCosts::GetEstimate(ValidationStage stage) const
+{
+    uint64_t nAverage = counters[static_cast<std::size_t>(stage)].nAverageCost.load(std::memory_order_relaxed);
+
+    // Nothing measured yet, assume the default cost
+    return nAverage > 0 ? nAverage : DEFAULT_STAGE_COSTS[static_cast<std::size_t>(stage)];
+}
+
+// Gets the counters of a stage.
+CValidationCosts::CStats CValidationCosts::GetStats(ValidationStage stage) const
+{
+    const CCounters& stageCounters = counters[static_cast<std::size_t>(stage)];
+
+    CStats stats;
+    stats.nRuns = stageCounters.nRuns.load(std::memory_order_relaxed);
+    stats.nRejects = stageCounters.nRejects.load(std::memory_order_relaxed);
+    stats.nAverageCost = stageCounters.nAverageCost.load(std::memory_order_relaxed);
+
+    return stats;
+}
+
+// Forgets every measurement.
+void CValidationCosts::Reset()
+{
+    for (CCounters& stageCounters : counters) {
+        stageCounters.nRuns.store(0, std::memory_order_relaxed);
+        stageCounters.nRejects.store(0, std::memory_order_relaxed);
+        stageCounters.nAverageCost.store(0, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,114 @@
+// Copyright (c) 2024 Marco Fortina
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#ifndef QYRA_VALIDATION_H
+#define QYRA_VALIDATION_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Stages of the staged solution validator, in the order they are accounted.
+ */
+enum class ValidationStage {
+    STRUCTURE,  ///< Size and layout of the solution.
+    ENCRYPTION, ///< Kyber-768 decapsulation and AES decryption of the header and nonce.
+    PATH,       ///< Graph build, longest path search and path hash.
+};
+
+/**
+ * @brief Number of validation stages.
+ */
+constexpr std::size_t NUM_VALIDATION_STAGES = 3;
+
+/**
+ * @brief Measured cost of every validation stage, shared by the whole library.
+ *
+ * Every stage run is timed and folded into an exponentially weighted moving
+ * average, so the validator can run the cheaper of the expensive stages first
+ * and refuse a stage that no longer fits in a caller's work budget.
+ */
+class CValidationCosts
+{
+public:
+    /**
+     * @brief Counters of a single stage.
+     */
+    struct CStats {
+        ///< Number of times the stage ran.
+        uint64_t nRuns = 0;
+
+        ///< Number of solutions the stage rejected.
+        uint64_t nRejects = 0;
+
+        ///< Moving average of the stage cost, in nanoseconds.
+        uint64_t nAverageCost = 0;
+    };
+
+    /**
+     * @brief Retrieves the costs shared by the whole library.
+     *
+     * @return A reference to the shared costs.
+     */
+    static CValidationCosts& Get();
+
+    CValidationCosts(const CValidationCosts&) = delete;
+    CValidationCosts& operator=(const CValidationCosts&) = delete;
+
+    /**
+     * @brief Records a run of a stage.
+     *
+     * @param stage The stage that ran.
+     * @param nCost Time spent in the stage, in nanoseconds.
+     * @param fRejected True if the stage rejected the solution.
+     */
+    void Record(ValidationStage stage, uint64_t nCost, bool fRejected);
+
+    /**
+     * @brief Gets the expected cost of a stage.
+     *
+     * @param stage The stage to estimate.
+     *
+     * @return The moving average of the stage cost in nanoseconds, or a conservative
+     *         default before its first run.
+     */
+    uint64_t GetEstimate(ValidationStage stage) const;
+
+    /**
+     * @brief Gets the counters of a stage.
+     *
+     * @param stage The stage to report.
+     *
+     * @return A snapshot of the counters.
+     */
+    CStats GetStats(ValidationStage stage) const;
+
+    /**
+     * @brief Forgets every measurement.
+     */
+    void Reset();
+
+private:
+    /**
+     * @brief Counters of a stage, on their own cache line.
+     */
+    struct alignas(64) CCounters {
+        ///< Number of times the stage ran.
+        std::atomic<uint64_t> nRuns{0};
+
+        ///< Number of solutions the stage rejected.
+        std::atomic<uint64_t> nRejects{0};
+
+        ///< Moving average of the stage cost, in nanoseconds.
+        std::atomic<uint64_t> nAverageCost{0};
+    };
+
+    CValidationCosts() = default;
+
+    ///< Counters indexed by stage.
+    CCounters counters[NUM_VALIDATION_STAGES];
+};
+
+#endif // QYRA_VALIDATION_H
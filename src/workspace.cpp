@@ -0,0 +1,143 @@
+// Copyright (c) 2024 Marco Fortina
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#include <workspace.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <sys/mman.h>
+
+// Size of a transparent huge page on x86-64 and AArch64 (with 4 KiB base pages).
+static constexpr std::size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+// Alignment of a regular slab, a cache line.
+static constexpr std::size_t SLAB_ALIGNMENT = 64;
+
+// Wipes the keys and data of the last user, drops the edges and the path and restores the default settings.
+void CWorkspace::Reset()
+{
+    graph.Wipe();
+    graph.Clear();
+    graph.SetNumThreads(1);
+    graph.SetIV({});
+    graph.SetEncapsulationReuse(1);
+    path.Clear();
+}
+
+// Retrieves the pool shared by the whole library.
+CWorkspacePool& CWorkspacePool::Get()
+{
+    static CWorkspacePool pool;
+    return pool;
+}
+
+// Destroys the workspaces and frees the slabs.
+CWorkspacePool::~CWorkspacePool()
+{
+    for (const CSlab& slab : slabs) {
+        for (std::size_t i = 0; i < slab.count; ++i) {
+            slab.workspaces[i].~CWorkspace();
+        }
+
+        std::free(slab.workspaces);
+    }
+}
+
+// Allocates, pre-faults and constructs a slab of workspaces (mutex must be held).
+void CWorkspacePool::AllocateSlab(std::size_t count, bool fHugePages)
+{
+    // aligned_alloc() needs a size that is a multiple of the alignment
+    std::size_t alignment = fHugePages ? HUGE_PAGE_SIZE : SLAB_ALIGNMENT;
+    std::size_t size = (count * sizeof(CWorkspace) + alignment - 1) / alignment * alignment;
+
+    void* memory = std::aligned_alloc(alignment, size);
+    if (!memory) {
+        throw std::bad_alloc();
+    }
+
+#ifdef MADV_HUGEPAGE
+    // Ask for huge pages before the first touch, it is only a hint
+    if (fHugePages) {
+        madvise(memory, size, MADV_HUGEPAGE);
+    }
+#endif
+
+    // Fault every page in now rather than on the first nonce
+    std::memset(memory, 0, size);
+
+    CWorkspace* workspaces = static_cast<CWorkspace*>(memory);
+    for (std::size_t i = 0; i < count; ++i) {
+        new (&workspaces[i]) CWorkspace();
+
+        // The path scratch lives outside the slab, fault it in now as well
+        workspaces[i].path.ReserveScratch();
+    }
+
+    slabs.push_back({workspaces, count});
+    nSize += count;
+
+    // Keep room for every workspace, so Release() never allocates
+    available.reserve(nSize);
+
+    // Hand out the workspaces in address order
+    for (std::size_t i = count; i > 0; --i) {
+        available.push_back(&workspaces[i - 1]);
+    }
+}
+
+// Makes sure a number of workspaces can be acquired without allocating.
+void CWorkspacePool::Reserve(std::size_t count, bool fHugePages)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (available.size() < count) {
+        AllocateSlab(count - available.size(), fHugePages);
+    }
+}
+
+// Takes a workspace from the pool, allocating a new slab if none is available.
+CWorkspace* CWorkspacePool::Acquire()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (available.empty()) {
+        AllocateSlab(1, false);
+    }
+
+    CWorkspace* workspace = available.back();
+    available.pop_back();
+
+    return workspace;
+}
+
+// Resets a workspace and gives it back to the pool.
+void CWorkspacePool::Release(CWorkspace* workspace)
+{
+    if (!workspace) {
+        return;
+    }
+
+    // Reset outside the lock, the workspace is still owned by the caller
+    workspace->Reset();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    available.push_back(workspace);
+}
+
+// Gets the number of workspaces that can be acquired without allocating.
+std::size_t CWorkspacePool::GetAvailable() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    return available.size();
+}
+
+// Gets the total number of workspaces owned by the pool.
+std::size_t CWorkspacePool::GetSize() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    return nSize;
+}
@@ -0,0 +1,135 @@
+// Copyright (c) 2024 Marco Fortina
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#ifndef QYRA_WORKSPACE_H
+#define QYRA_WORKSPACE_H
+
+#include <graph.h>
+#include <path.h>
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+/**
+ * @brief Graph and path scratch objects used together to mine or validate a solution.
+ */
+struct CWorkspace {
+    ///< Graph rebuilt for every nonce or solution.
+    CGraph graph;
+
+    ///< Path found in the graph.
+    CPath path;
+
+    /**
+     * @brief Wipes the keys and data of the last user, drops the edges and the path and
+     * restores the default search, IV and encapsulation settings.
+     *
+     * A reset workspace holds nothing of its previous user, like a newly constructed one.
+     * The buffers keep their capacity, so reusing the workspace does not allocate.
+     */
+    void Reset();
+};
+
+/**
+ * @brief A pool of reusable workspaces shared by the whole library.
+ *
+ * Workspaces are carved out of slabs that are zero-filled when allocated, so all
+ * of their pages are faulted in up front, optionally on transparent huge pages.
+ * The search scratch of each path is allocated and zero-filled with its slab.
+ * A released workspace is handed out again as is, so steady-state mining and
+ * validation touch neither the allocator nor the page-fault handler.
+ */
+class CWorkspacePool
+{
+public:
+    /**
+     * @brief Retrieves the pool shared by the whole library.
+     *
+     * @return A reference to the shared pool.
+     */
+    static CWorkspacePool& Get();
+
+    /**
+     * @brief Destroys the workspaces and frees the slabs.
+     */
+    ~CWorkspacePool();
+
+    CWorkspacePool(const CWorkspacePool&) = delete;
+    CWorkspacePool& operator=(const CWorkspacePool&) = delete;
+
+    /**
+     * @brief Makes sure a number of workspaces can be acquired without allocating.
+     *
+     * @param count Number of workspaces that must be available.
+     * @param fHugePages True to back the new slab with transparent huge pages, where supported.
+     */
+    void Reserve(std::size_t count, bool fHugePages = false);
+
+    /**
+     * @brief Takes a workspace from the pool, allocating a new slab if none is available.
+     *
+     * @return A pointer to the workspace, to be given back with Release().
+     *
+     * @throws std::bad_alloc If a new slab cannot be allocated.
+     */
+    CWorkspace* Acquire();
+
+    /**
+     * @brief Resets a workspace and gives it back to the pool.
+     *
+     * @param workspace The workspace returned by Acquire().
+     */
+    void Release(CWorkspace* workspace);
+
+    /**
+     * @brief Gets the number of workspaces that can be acquired without allocating.
+     *
+     * @return The number of available workspaces.
+     */
+    std::size_t GetAvailable() const;
+
+    /**
+     * @brief Gets the total number of workspaces owned by the pool.
+     *
+     * @return The number of workspaces, acquired or not.
+     */
+    std::size_t GetSize() const;
+
+private:
+    /**
+     * @brief A block of memory holding consecutive workspaces.
+     */
+    struct CSlab {
+        ///< First workspace of the slab.
+        CWorkspace* workspaces;
+
+        ///< Number of workspaces in the slab.
+        std::size_t count;
+    };
+
+    CWorkspacePool() = default;
+
+    /**
+     * @brief Allocates, pre-faults and constructs a slab of workspaces (mutex must be held).
+     *
+     * @param count Number of workspaces in the slab.
+     * @param fHugePages True to back the slab with transparent huge pages, where supported.
+     */
+    void AllocateSlab(std::size_t count, bool fHugePages);
+
+    ///< Protects the members below.
+    mutable std::mutex mutex;
+
+    ///< Slabs owned by the pool.
+    std::vector<CSlab> slabs;
+
+    ///< Workspaces available for Acquire(), the most recently released last.
+    std::vector<CWorkspace*> available;
+
+    ///< Total number of workspaces in the slabs.
+    std::size_t nSize = 0;
+};
+
+#endif // QYRA_WORKSPACE_H